@@ -0,0 +1,143 @@
+#include <chrono>
+#define GLEW_NO_GLU
+#include <GL/glew.h>
+#include "assetLoader.h"
+#include "logging.h"
+
+namespace gl
+{
+
+AssetLoader::AssetLoader(uint32_t numWorkers) : _pUploading(nullptr), _numJobs(0), _numDone(0), _isStopping(false)
+{
+    /// The GL thread has its own work while loading
+    if(numWorkers == 0)
+    {
+        uint32_t numCores = std::thread::hardware_concurrency();
+        numWorkers = (numCores > 1) ? numCores - 1 : 1;
+    }
+
+    for(uint32_t i = 0; i < numWorkers; i++)
+        _workers.push_back(std::thread(&AssetLoader::work, this));
+
+    Log("[AssetLoader] %u worker threads \n", numWorkers);
+}
+
+AssetLoader::~AssetLoader()
+{
+    Stop();
+
+    while(!_loaded.empty())
+    {
+        delete _loaded.front();
+        _loaded.pop_front();
+    }
+
+    if(_pUploading)
+        delete _pUploading;
+}
+
+void AssetLoader::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _isStopping = true;
+
+        while(!_pending.empty())
+        {
+            delete _pending.front();
+            _pending.pop_front();
+        }
+    }
+    _cond.notify_all();
+
+    for(uint32_t i = 0; i < _workers.size(); i++)
+        _workers[i].join();
+    _workers.clear();
+}
+
+void AssetLoader::Submit(const char* name, AssetLoadFunc load, AssetUploadFunc upload)
+{
+    AssetJob* pJob = new AssetJob;
+    pJob->Name = name;
+    pJob->Load = load;
+    pJob->Upload = upload;
+    pJob->IsLoaded = true;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(_isStopping)
+        {
+            delete pJob;
+            return;
+        }
+
+        if(load)
+            _pending.push_back(pJob);
+        else
+            _loaded.push_back(pJob);
+        _numJobs++;
+    }
+    _cond.notify_one();
+}
+
+void AssetLoader::work()
+{
+    while(true)
+    {
+        AssetJob* pJob;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this]() { return _isStopping || !_pending.empty(); });
+            if(_isStopping)
+                return;
+
+            pJob = _pending.front();
+            _pending.pop_front();
+        }
+
+        pJob->IsLoaded = pJob->Load();
+        if(!pJob->IsLoaded)
+            LogError("[AssetLoader] fail to load %s \n", pJob->Name.c_str());
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        _loaded.push_back(pJob);
+    }
+}
+
+bool AssetLoader::Update(double budget)
+{
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+    do
+    {
+        if(_pUploading == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if(_loaded.empty())
+                break;
+
+            _pUploading = _loaded.front();
+            _loaded.pop_front();
+        }
+
+        /// A job whose load failed has nothing to upload
+        if(!_pUploading->IsLoaded || _pUploading->Upload == nullptr || _pUploading->Upload())
+        {
+            delete _pUploading;
+            _pUploading = nullptr;
+            _numDone++;
+        }
+        else
+        {
+            /// An unfinished job, such as one waiting for the driver, lets the other jobs go first
+            std::lock_guard<std::mutex> lock(_mutex);
+            _loaded.push_back(_pUploading);
+            _pUploading = nullptr;
+        }
+    }
+    while(std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() < budget);
+
+    return IsDone();
+}
+
+}   /// namespace gl
@@ -12,10 +12,15 @@ uniform mat4 PV;
 uniform mat4 M;
 uniform mat3 normalMat;
 
+// Packed positions are in [-1, 1] over the bounding box of the mesh. Offset 0 and scale 1 for float vertices.
+uniform vec3 posOffset;
+uniform vec3 posScale;
+
 void main()
 {
-	gl_Position = PV * M * vec4(position, 1.0f);
-	FragPos = vec3(M * vec4(position, 1.0f));
+	vec3 pos = posOffset + position * posScale;
+	gl_Position = PV * M * vec4(pos, 1.0f);
+	FragPos = vec3(M * vec4(pos, 1.0f));
 	TexCoords = texCoords;
 	Normal = normalMat * normal;
 }
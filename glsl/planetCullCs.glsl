@@ -0,0 +1,94 @@
+#version 430
+
+layout (local_size_x = 64) in;
+
+#define MAX_LODS	4	/// Should be same with CULL_MAX_LODS in planetObject.h
+
+struct DrawElementsIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int  baseVertex;
+	uint baseInstance;
+};
+
+/// All asteroid matrices, written once
+layout (std430, binding = 0) readonly buffer InstanceMatrices
+{
+	mat4 instanceMatrices[];
+};
+
+/// Matrices of visible asteroids, used as the instance attribute buffer
+/// Each level of detail has a range starting at baseInstance of its command
+layout (std430, binding = 1) writeonly buffer VisibleMatrices
+{
+	mat4 visibleMatrices[];
+};
+
+/// A command per level of detail. instanceCount is cleared before dispatch and counts visible asteroids.
+layout (std430, binding = 2) buffer DrawCommands
+{
+	DrawElementsIndirectCommand commands[];
+};
+
+/// Studio environment shared by all shaders. ( std140, StudioEnvBlock in studioEnv.h )
+#define MAX_POINT_LIGHTS 16
+
+layout (std140) uniform StudioEnvBlock
+{
+    vec3    lightPos;
+    vec3    lightAmbient;
+    vec3    lightDiffuse;
+    vec3    lightSpecular;
+    vec3    viewPos;
+    vec2    screenSize;
+    int     numPointLights;
+    float   projScale;
+    vec3    pointLightPos[MAX_POINT_LIGHTS];
+} env;
+
+uniform mat4 M;
+uniform vec4 boundSphere;		/// Bounding sphere of the mesh in model space
+uniform vec4 frustumPlanes[6];	/// World space planes. Normals point inside.
+uniform int  instanceCount;
+
+uniform float lodErrors[MAX_LODS];	/// Simplification error of each level in model space over the allowed pixel error
+uniform int   lodCount;
+
+void main()
+{
+	uint id = gl_GlobalInvocationID.x;
+	if (id >= uint(instanceCount))
+		return;
+
+	mat4 world = M * instanceMatrices[id];
+	vec3 center = vec3(world * vec4(boundSphere.xyz, 1.0f));
+
+	/// The largest axis scale keeps the sphere conservative
+	float scale2 = max(dot(world[0].xyz, world[0].xyz), max(dot(world[1].xyz, world[1].xyz), dot(world[2].xyz, world[2].xyz)));
+	float radius = boundSphere.w * sqrt(scale2);
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(frustumPlanes[i].xyz, center) + frustumPlanes[i].w < -radius)
+			return;
+	}
+
+	/// The coarsest level whose error on screen is small enough, same as MeshObject::selectLod
+	uint lod = 0u;
+	float distance = length(center - env.viewPos) - radius;
+	if (distance > 0.0f)
+	{
+		float scale = sqrt(scale2);
+		for (int i = 1; i < lodCount; i++)
+		{
+			if (lodErrors[i] * scale * env.projScale > distance)
+				break;
+			lod = uint(i);
+		}
+	}
+
+	uint slot = atomicAdd(commands[lod].instanceCount, 1u);
+	visibleMatrices[commands[lod].baseInstance + slot] = instanceMatrices[id];
+}
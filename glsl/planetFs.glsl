@@ -9,15 +9,6 @@ flat in int InstanceID;
 // output
 out vec4 color;
 
-// viewer
-uniform vec3 viewPos;
-
-// light
-uniform vec3 lightPos;
-uniform vec3 lightAmbient;
-uniform vec3 lightDiffuse;
-uniform vec3 lightSpecular;
-
 // point light
 uniform float 	pointLightConstance = 1.0f;
 uniform float 	pointLightLinear = 0.09f;
@@ -28,19 +19,26 @@ uniform float 	  textureShininess;
 uniform sampler2D textureDiffuse1;
 uniform sampler2D textureSpecular1;
 
-// multiple point lights
-#define NUM_POINT_LIGHTS 6
-
-struct PointLight {
-    vec3 position;
-};
+// Studio environment shared by all shaders. ( std140, StudioEnvBlock in studioEnv.h )
+#define MAX_POINT_LIGHTS 16
 
-uniform PointLight pointLights[NUM_POINT_LIGHTS];
-
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+layout (std140) uniform StudioEnvBlock
+{
+    vec3    lightPos;
+    vec3    lightAmbient;
+    vec3    lightDiffuse;
+    vec3    lightSpecular;
+    vec3    viewPos;
+    vec2    screenSize;
+    int     numPointLights;
+    float   projScale;
+    vec3    pointLightPos[MAX_POINT_LIGHTS];
+} env;
+
+vec3 calcPointLight(vec3 lightPosition, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // Diffuse
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(lightPosition - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
     // Specular
@@ -48,12 +46,12 @@ vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), textureShininess);
 
     // Attenuation
-    float distance = length(light.position - fragPos);
+    float distance = length(lightPosition - fragPos);
     float attenuation = 1.0f / (pointLightConstance + pointLightLinear * distance + pointLightQuadratic * (distance * distance));    
 
-    vec3 ambient = lightAmbient * vec3(texture(textureDiffuse1, TexCoords));
-    vec3 diffuse = lightDiffuse * diff * vec3(texture(textureDiffuse1, TexCoords));
-    vec3 specular = lightSpecular * spec * vec3(texture(textureSpecular1, TexCoords));
+    vec3 ambient = env.lightAmbient * vec3(texture(textureDiffuse1, TexCoords));
+    vec3 diffuse = env.lightDiffuse * diff * vec3(texture(textureDiffuse1, TexCoords));
+    vec3 specular = env.lightSpecular * spec * vec3(texture(textureSpecular1, TexCoords));
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -65,24 +63,24 @@ vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 void main()
 {
     // Ambient
-    vec3 ambient = lightAmbient * vec3(texture(textureDiffuse1, TexCoords));
+    vec3 ambient = env.lightAmbient * vec3(texture(textureDiffuse1, TexCoords));
   	
     // Diffuse 
     vec3 norm = normalize(Normal);
-    vec3 lightDir = normalize(lightPos - FragPos);
+    vec3 lightDir = normalize(env.lightPos - FragPos);
     float diff = max(dot(norm, lightDir), 0.0);
-    vec3 diffuse = lightDiffuse * diff * vec3(texture(textureDiffuse1, TexCoords));  
+    vec3 diffuse = env.lightDiffuse * diff * vec3(texture(textureDiffuse1, TexCoords));  
     
     // Specular
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(env.viewPos - FragPos);
     vec3 reflectDir = reflect(-lightDir, norm);  
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), textureShininess);
-    vec3 specular = lightSpecular * spec * vec3(texture(textureSpecular1, TexCoords));
+    vec3 specular = env.lightSpecular * spec * vec3(texture(textureSpecular1, TexCoords));
 
     vec3 lightColor = ambient + diffuse + specular;  
 
-    for(int i = 0; i < NUM_POINT_LIGHTS; i++)
-        lightColor += calcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    for(int i = 0; i < env.numPointLights; i++)
+        lightColor += calcPointLight(env.pointLightPos[i], norm, FragPos, viewDir);    
 
     color = vec4(lightColor, 1.0f);
 }
@@ -1,32 +1,35 @@
-#version 400
+#version 330
 
 out vec4 outColor;
 
-in vec3 gNormal;
+in vec3 Normal;
 in vec3 FragPos;
+in vec3 ObjectColor;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform vec3 lightColor;
-uniform vec3 objectColor;
+// Studio environment shared by all shaders. ( std140, StudioEnvBlock in studioEnv.h )
+#define MAX_POINT_LIGHTS 16
 
-// multiple point lights
-#define NUM_POINT_LIGHTS 6
+layout (std140) uniform StudioEnvBlock
+{
+    vec3    lightPos;
+    vec3    lightAmbient;
+    vec3    lightDiffuse;
+    vec3    lightSpecular;
+    vec3    viewPos;
+    vec2    screenSize;
+    int     numPointLights;
+    float   projScale;
+    vec3    pointLightPos[MAX_POINT_LIGHTS];
+} env;
 
 uniform float 	pointLightConstance = 1.0f;
 uniform float 	pointLightLinear = 0.09f;
 uniform float 	pointLightQuadratic = 0.032f;
 
-struct PointLight {
-    vec3 position;
-};
-
-uniform PointLight pointLights[NUM_POINT_LIGHTS];
-
-vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 calcPointLight(vec3 lightPosition, vec3 lightColor, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
     // Diffuse
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(lightPosition - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
     // Specular
@@ -34,12 +37,12 @@ vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
 
     // Attenuation
-    float distance = length(light.position - fragPos);
+    float distance = length(lightPosition - fragPos);
     float attenuation = 1.0f / (pointLightConstance + pointLightLinear * distance + pointLightQuadratic * (distance * distance));    
 
-    vec3 ambient = 0.05f * lightColor * objectColor;
-    vec3 diffuse = 0.8f * lightColor * diff * objectColor;
-    vec3 specular = 1.0f * lightColor * spec * objectColor;
+    vec3 ambient = 0.05f * lightColor * ObjectColor;
+    vec3 diffuse = 0.8f * lightColor * diff * ObjectColor;
+    vec3 specular = 1.0f * lightColor * spec * ObjectColor;
 
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -50,27 +53,29 @@ vec3 calcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 
 void main()
 {
+	vec3 lightColor = env.lightSpecular;
+
 	// Ambient
 	float ambientStrength = 0.05f;
 	vec3 ambient = ambientStrength * lightColor;
 
 	// Diffuse
-	vec3 norm = normalize(gNormal);
-	vec3 lightDir = normalize(lightPos - FragPos);
+	vec3 norm = normalize(Normal);
+	vec3 lightDir = normalize(env.lightPos - FragPos);
 	float diff = max(dot(norm, lightDir), 0.0);
 	vec3 diffuse = 0.4f * diff * lightColor;
 
 	// Specular
 	float specularStrength = 0.5f;
-	vec3 viewDir = normalize(viewPos - FragPos);
+	vec3 viewDir = normalize(env.viewPos - FragPos);
 	vec3 reflectDir = reflect(-lightDir, norm); 
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32);
 	vec3 specular = specularStrength * spec * lightColor;  
 
-	vec3 result = (ambient + diffuse + specular) * objectColor;
+	vec3 result = (ambient + diffuse + specular) * ObjectColor;
 
-	for(int i = 0; i < NUM_POINT_LIGHTS; i++)
-		result += calcPointLight(pointLights[i], norm, FragPos, viewDir);    
+	for(int i = 0; i < env.numPointLights; i++)
+		result += calcPointLight(env.pointLightPos[i], lightColor, norm, FragPos, viewDir);    
 
 	outColor = vec4(result, 1.0f);
 }
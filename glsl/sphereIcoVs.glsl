@@ -0,0 +1,21 @@
+#version 330
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 instancePosScale;	// xyz : position, w : scale
+layout (location = 2) in vec3 instanceColor;
+
+out vec3 Normal;
+out vec3 FragPos;	// for light calculatoin in the world space
+out vec3 ObjectColor;
+
+uniform mat4 PV;
+
+void main()
+{
+	// Vertices of the icosphere are on the unit sphere, so the position is also the normal
+	Normal = position;
+	// model matrix of an instance has only translation and uniform scale
+	FragPos = instancePosScale.xyz + instancePosScale.w * position;
+	ObjectColor = instanceColor;
+	gl_Position = PV * vec4(FragPos, 1);
+}
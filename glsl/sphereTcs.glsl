@@ -3,21 +3,97 @@
 layout(vertices = 3) out;
 
 in vec3 vPosition[];
+in vec4 vPosScale[];
+in vec3 vColor[];
 out vec3 tcPosition[];
+out vec4 tcPosScale[];
+out vec3 tcColor[];
 
-float tessLevelInner = 16.0f;
-float tessLevelOuter = 16.0f;
+// Studio environment shared by all shaders. ( std140, StudioEnvBlock in studioEnv.h )
+#define MAX_POINT_LIGHTS 16
+
+layout (std140) uniform StudioEnvBlock
+{
+    vec3    lightPos;
+    vec3    lightAmbient;
+    vec3    lightDiffuse;
+    vec3    lightSpecular;
+    vec3    viewPos;
+    vec2    screenSize;
+    int     numPointLights;
+    float   projScale;
+    vec3    pointLightPos[MAX_POINT_LIGHTS];
+} env;
+
+uniform vec4  frustumPlanes[6];	// World space planes. Normals point inside.
+uniform float tessPixels;		// Target length of a tessellated edge on screen
+uniform float maxTessLevel;
+
+// Level of an edge from its length on screen.
+// Neighbouring patches compute the same value for a shared edge, so no crack opens between them.
+float edgeTessLevel(vec3 a, vec3 b)
+{
+	float distance = max(length((a + b) * 0.5f - env.viewPos), 1e-3f);
+	float pixels = length(a - b) * env.projScale / distance;
+	return clamp(pixels / tessPixels, 1.0f, maxTessLevel);
+}
+
+// The patch is out of the view frustum or faces away from the viewer entirely
+bool isPatchCulled(vec3 center, float scale, vec3 dirs[3])
+{
+	// Spherical patch is bounded by the sphere around its middle point through its corners
+	vec3 axis = normalize(dirs[0] + dirs[1] + dirs[2]);
+	float cosCone = min(dot(axis, dirs[0]), min(dot(axis, dirs[1]), dot(axis, dirs[2])));
+	float radius = scale * sqrt(max(2.0f - 2.0f * cosCone, 0.0f));
+	vec3 patchCenter = center + scale * axis;
+
+	for (int i = 0; i < 6; i++)
+	{
+		if (dot(frustumPlanes[i].xyz, patchCenter) + frustumPlanes[i].w < -radius)
+			return true;
+	}
+
+	// A point of the sphere is seen when its direction is within the horizon around the viewer.
+	// No normal of the patch is inside, if the cone of its normals is beyond the horizon.
+	vec3 toView = env.viewPos - center;
+	float viewDistance = length(toView);
+	if (viewDistance <= scale)
+		return false;
+
+	float horizon = acos(scale / viewDistance);
+	float axisAngle = acos(clamp(dot(axis, toView / viewDistance), -1.0f, 1.0f));
+	return axisAngle - acos(clamp(cosCone, -1.0f, 1.0f)) > horizon;
+}
 
 void main()
 {
 	tcPosition[gl_InvocationID] = vPosition[gl_InvocationID];
+	tcPosScale[gl_InvocationID] = vPosScale[gl_InvocationID];
+	tcColor[gl_InvocationID] = vColor[gl_InvocationID];
 	if (gl_InvocationID == 0) 
 	{
-		gl_TessLevelInner[0] = tessLevelInner;
+		vec3 center = vPosScale[0].xyz;
+		float scale = vPosScale[0].w;
+		vec3 dirs[3] = vec3[3](normalize(vPosition[0]), normalize(vPosition[1]), normalize(vPosition[2]));
+
+		// Outer level 0 discards the patch before the tessellator
+		if (isPatchCulled(center, scale, dirs))
+		{
+			gl_TessLevelOuter[0] = 0.0f;
+			gl_TessLevelOuter[1] = 0.0f;
+			gl_TessLevelOuter[2] = 0.0f;
+			gl_TessLevelInner[0] = 0.0f;
+			return;
+		}
 
-		gl_TessLevelOuter[0] = tessLevelOuter;
-		gl_TessLevelOuter[1] = tessLevelOuter;
-		gl_TessLevelOuter[2] = tessLevelOuter;
+		vec3 p0 = center + scale * dirs[0];
+		vec3 p1 = center + scale * dirs[1];
+		vec3 p2 = center + scale * dirs[2];
+
+		// An outer level is for the edge opposite to the vertex of the same index
+		gl_TessLevelOuter[0] = edgeTessLevel(p1, p2);
+		gl_TessLevelOuter[1] = edgeTessLevel(p2, p0);
+		gl_TessLevelOuter[2] = edgeTessLevel(p0, p1);
+		gl_TessLevelInner[0] = max(gl_TessLevelOuter[0], max(gl_TessLevelOuter[1], gl_TessLevelOuter[2]));
 	}
 }
-
@@ -2,11 +2,13 @@
 
 layout(triangles, equal_spacing, cw) in;
 in vec3 tcPosition[];
-out vec3 tePosition;
-out vec3 fragPos;	// for light calculatoin in the world space
+in vec4 tcPosScale[];
+in vec3 tcColor[];
+out vec3 Normal;
+out vec3 FragPos;	// for light calculatoin in the world space
+out vec3 ObjectColor;
 
 uniform mat4 PV;
-uniform mat4 M;
 
 void main()
 {
@@ -14,7 +16,10 @@ void main()
 	vec3 p1 = gl_TessCoord.y * tcPosition[1];
 	vec3 p2 = gl_TessCoord.z * tcPosition[2];
 
-	tePosition = normalize(p0 + p1 + p2);
-	fragPos = vec3(M * vec4(tePosition, 1.0f));
-	gl_Position = PV * M * vec4(tePosition, 1);
+	// Normal of a sphere with uniform scale is the direction from its center
+	Normal = normalize(p0 + p1 + p2);
+	// model matrix of an instance has only translation and uniform scale
+	FragPos = tcPosScale[0].xyz + tcPosScale[0].w * Normal;
+	ObjectColor = tcColor[0];
+	gl_Position = PV * vec4(FragPos, 1);
 }
@@ -1,9 +1,16 @@
 #version 400
 
 layout (location = 0) in vec3 position;
+layout (location = 1) in vec4 instancePosScale;	// xyz : position, w : scale
+layout (location = 2) in vec3 instanceColor;
+
 out vec3 vPosition;
+out vec4 vPosScale;
+out vec3 vColor;
 
 void main()
 {
 	vPosition = position;
+	vPosScale = instancePosScale;
+	vColor = instanceColor;
 }
@@ -1,12 +1,17 @@
 #version 400
 
 in vec2 TexCoords;
+in vec3 FontColor;
 out vec4 color;
 
 uniform sampler2D texImg;
-uniform vec3 fontColor;
 
 void main()
 {    
-	color = vec4(fontColor, texture(texImg, TexCoords).r);
+	/// Signed distance field. 0.5 is the outline.
+	/// The edge is smoothed over one screen pixel at any scale.
+	float dist = texture(texImg, TexCoords).r;
+	float width = fwidth(dist);
+	float alpha = smoothstep(0.5 - width, 0.5 + width, dist);
+	color = vec4(FontColor, alpha);
 }  
@@ -1,7 +1,9 @@
 #version 400
 
 layout (location = 0) in vec4 vertex;
+layout (location = 1) in vec3 color;
 out vec2 TexCoords;
+out vec3 FontColor;
 
 uniform mat4 proj;
 
@@ -9,4 +11,5 @@ void main()
 {
     gl_Position = proj * vec4(vertex.xy, -1.0, 1.0);
     TexCoords = vertex.zw;
+    FontColor = color;
 }  
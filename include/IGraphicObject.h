@@ -1,7 +1,9 @@
 #ifndef IGRAPHIC_OBJECT_H
 #define IGRAPHIC_OBJECT_H
+#include <stdint.h>
 #include <glm/glm.hpp>
 #include "studioEnv.h"
+#include "frustum.h"
 
 using namespace std;
 
@@ -43,8 +45,19 @@ public:
      */
     virtual bool Initialize() = 0;
 
+    /**
+     * @brief   Advance the simulation of an object, such as movement and internal timers.
+     *          This must not touch any GL state, so that game logic can run without a GL context.
+     *          A studio updates every object before drawing any of them in a frame.
+     *
+     * @param dt        Elapsed time since the previous update in seconds
+     * @param studioEnv Current environment information of a studio object
+     */
+    virtual void Update(const double dt, StudioEnv& studioEnv) = 0;
+
     /**
      * @brief   Draw a frame into a back buffer to display at next frame.
+     *          Only renders the status computed by the last "Update".
      *
      * @param time      Current time
      * @param PV        Project/View matrix
@@ -95,6 +108,77 @@ public:
      * @return objInfo    Current information
      */
     virtual void GetCurObjectInfo(struct ObjectInfo& objInfo) = 0;
+
+    /**
+     * @brief   Get the number of instances this object draws.
+     *          An object drawing many instances at once, such as instanced bombs,
+     *          exposes every instance through the instance methods below.
+     * @return  the number of instances
+     */
+    virtual uint32_t GetInstanceCount() { return 1; }
+
+    /**
+     * @brief   Get current information of an instance
+     * @param index       instance index
+     * @return objInfo    Current information
+     */
+    virtual void GetInstanceInfo(uint32_t index, struct ObjectInfo& objInfo) { GetCurObjectInfo(objInfo); }
+
+    /**
+     * @brief   Reset Internal status of an instance
+     * @param index       instance index
+     * @param studioEnv   Current environment information of a studio object
+     */
+    virtual void ResetInstance(uint32_t index, StudioEnv& studioEnv) { Reset(studioEnv); }
+
+    /**
+     * @brief   Check instances of this object never move after "Initialize"
+     *          Bounds of static instances are not refreshed every update by collision detection.
+     * @return  true if static
+     */
+    virtual bool IsStatic() { return false; }
+
+    /**
+     * @brief   Get the bounding sphere of an instance for picking
+     * @param index       instance index
+     * @return center     sphere center in world space
+     * @return radius     sphere radius
+     * @return  false if the instance cannot be picked
+     */
+    virtual bool GetInstanceBound(uint32_t index, glm::vec3& center, float& radius) { return false; }
+
+    /**
+     * @brief   Check an instance is intersected with the ray exactly
+     * @param index     instance index
+     * @param rayOrg    Ray origin in world space
+     * @param rayDir    Normalized ray direction in world space
+     * @return  distance    distance from ray origin when the instance is intersected
+     * @return  result of method
+     */
+    virtual bool IsInstanceIntersected(uint32_t index, glm::vec3 rayOrg, glm::vec3 rayDir, float *distance)
+    {
+        return IsIntersected(rayOrg, rayDir, distance);
+    }
+
+    /**
+     * @brief   Update focus status of an instance
+     * @param index        instance index
+     * @param isFocused    set current status if this is focused or not
+     * @param focusColor   focus color;
+     */
+    virtual void FocusInstance(uint32_t index, bool isFocused, glm::vec3 focusColor = glm::vec3(0))
+    {
+        Focus(isFocused, focusColor);
+    }
+
+    /**
+     * @brief   Test the bounding sphere of this object against the view frustum before drawing.
+     *          An instanced object also removes invisible instances from its next draw.
+     *          Objects without bounds, such as a stage, are always visible.
+     * @param frustum     View frustum in world space
+     * @return  false if nothing of this object is visible
+     */
+    virtual bool CullByFrustum(const Frustum& frustum) { return true; }
 };
 }   // gl
 #endif // IGRAPHIC_OBJECT_H
@@ -0,0 +1,102 @@
+#ifndef ASSET_LOADER_H_INCLUDED
+#define ASSET_LOADER_H_INCLUDED
+
+#include <stdint.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace gl
+{
+
+using namespace std;
+
+/// Runs on a worker thread, such as parsing a file or decoding an image. No GL calls.
+typedef function<bool()> AssetLoadFunc;
+
+/// Runs on the GL thread after the load finished. Returns false to be called again in the next chance,
+/// so a large upload can be split into small steps, or it can wait for a program the driver is compiling.
+typedef function<bool()> AssetUploadFunc;
+
+/**
+ * @brief   Loads assets on a pool of worker threads and uploads them on the GL thread
+ *          Each job has two parts. The load part runs on any worker, so independent assets are
+ *          read and decoded at the same time. Finished jobs are queued for the GL thread,
+ *          which drains the queue by "Update" within a time budget every frame,
+ *          so the window keeps responding while loading.
+ */
+class AssetLoader
+{
+public:
+    /**
+     * @brief   Constructor of AssetLoader object
+     *
+     * @param numWorkers    The number of worker threads. 0 uses all cores except the GL thread.
+     */
+    explicit AssetLoader(uint32_t numWorkers = 0);
+
+    /**
+     * @brief   Destructor of AssetLoader object
+     */
+    ~AssetLoader();
+
+    AssetLoader(const AssetLoader&) = delete;
+    AssetLoader& operator=(const AssetLoader&) = delete;
+
+    /**
+     * @brief   Add a job. Jobs are loaded in the submitted order, but they may finish in any order.
+     *
+     * @param name      Name for logging
+     * @param load      Work on a worker thread. nullptr if the job only has the GL part.
+     * @param upload    Work on the GL thread. It is skipped when the load part failed.
+     */
+    void Submit(const char* name, AssetLoadFunc load, AssetUploadFunc upload);
+
+    /**
+     * @brief   Upload loaded jobs on the GL thread until the time budget is used up
+     *          At least one upload step runs per call, so loading always makes progress.
+     *
+     * @param budget    Time budget in seconds
+     * @return  true if all submitted jobs are done
+     */
+    bool Update(double budget);
+
+    /**
+     * @brief   Drop jobs which have not started and wait for the running ones
+     *          Jobs submitted after this are not loaded.
+     */
+    void Stop();
+
+    bool        IsDone() const { return _numDone == _numJobs; }
+    uint32_t    GetNumJobs() const { return _numJobs; }
+    uint32_t    GetNumDoneJobs() const { return _numDone; }
+
+private:
+    struct AssetJob
+    {
+        string          Name;
+        AssetLoadFunc   Load;
+        AssetUploadFunc Upload;
+        bool            IsLoaded;   /// Result of the load part
+    };
+
+    vector<thread>      _workers;
+    mutex               _mutex;
+    condition_variable  _cond;
+    deque<AssetJob*>    _pending;       /// Waiting for a worker
+    deque<AssetJob*>    _loaded;        /// Waiting for the GL thread
+    AssetJob*           _pUploading;    /// Job whose upload step is running
+    uint32_t            _numJobs;
+    uint32_t            _numDone;
+    bool                _isStopping;
+
+    void work();
+};
+
+}   /// namespace gl
+
+#endif // ASSET_LOADER_H_INCLUDED
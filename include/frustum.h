@@ -0,0 +1,77 @@
+#ifndef FRUSTUM_H_INCLUDED
+#define FRUSTUM_H_INCLUDED
+
+#include <glm/glm.hpp>
+
+namespace gl
+{
+
+/**
+ * @brief   Planes of a view frustum in world space
+ *          Planes are extracted from a Projection/View matrix (Gribb/Hartmann method).
+ *          Each plane is stored as (normal, distance) and the normal points into the frustum.
+ */
+struct Frustum
+{
+    enum {
+        PLANE_LEFT,
+        PLANE_RIGHT,
+        PLANE_BOTTOM,
+        PLANE_TOP,
+        PLANE_NEAR,
+        PLANE_FAR,
+        NUM_PLANES
+    };
+
+    glm::vec4   Planes[NUM_PLANES];
+
+    Frustum() {}
+
+    explicit Frustum(const glm::mat4& PV) { Extract(PV); }
+
+    /**
+     * @brief   Extract frustum planes
+     *
+     * @param PV    Projection/View matrix
+     */
+    void Extract(const glm::mat4& PV)
+    {
+        /// Rows of the matrix. glm matrices are column major.
+        glm::vec4 row0(PV[0][0], PV[1][0], PV[2][0], PV[3][0]);
+        glm::vec4 row1(PV[0][1], PV[1][1], PV[2][1], PV[3][1]);
+        glm::vec4 row2(PV[0][2], PV[1][2], PV[2][2], PV[3][2]);
+        glm::vec4 row3(PV[0][3], PV[1][3], PV[2][3], PV[3][3]);
+
+        Planes[PLANE_LEFT]   = row3 + row0;
+        Planes[PLANE_RIGHT]  = row3 - row0;
+        Planes[PLANE_BOTTOM] = row3 + row1;
+        Planes[PLANE_TOP]    = row3 - row1;
+        Planes[PLANE_NEAR]   = row3 + row2;
+        Planes[PLANE_FAR]    = row3 - row2;
+
+        /// Normalize, so that a plane equation gives the signed distance
+        for(int i = 0; i < NUM_PLANES; i++)
+            Planes[i] /= glm::length(glm::vec3(Planes[i]));
+    }
+
+    /**
+     * @brief   Check a bounding sphere is inside or intersects the frustum
+     *
+     * @param center    sphere center in world space
+     * @param radius    sphere radius
+     * @return  false if the sphere is completely outside
+     */
+    bool IsSphereVisible(const glm::vec3& center, float radius) const
+    {
+        for(int i = 0; i < NUM_PLANES; i++)
+        {
+            if(glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+};
+
+}   /// namespace gl
+
+#endif // FRUSTUM_H_INCLUDED
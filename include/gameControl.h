@@ -22,6 +22,7 @@ class GameControl
     double      _stageClearTime;
     double      _shotTime;
     bool        _isFirst;
+    unsigned    _version;       /// Changes whenever energy or stage changes
 
 public:
     GameControl(){
@@ -32,12 +33,14 @@ public:
         _stageClearTime = 0.f;
         _shotTime = 0.f;
         _isFirst = true;
+        _version = 0;
     };
 
     ~GameControl(){};
 
     void AttackEnermy(){
         _enermyEnergy--;
+        _version++;
         if(_enermyEnergy <= 0)
         {
             GotoNextStage();
@@ -47,6 +50,7 @@ public:
 
     void Damaged(){
         _playerEnergy--;
+        _version++;
         _damagedTime = glfwGetTime();
     }
 
@@ -84,18 +88,23 @@ public:
     int GetPlayerEnergy() { return _playerEnergy; }
     int GetCurStage() {return _stage; }
 
+    /// Compare with the value of a previous call to find any change of energy or stage
+    unsigned GetStatusVersion() { return _version; }
+
     bool IsGameEnded(){
         if(_playerEnergy <= 0) return true;
         else return false;
     }
 
     void Restart() {
+        _version++;
         _playerEnergy = PLAYER_ENERGY;
         _enermyEnergy = ENERMY_ENERGY;
         _stage = 1;
     }
 
     void GotoNextStage() {
+        _version++;
         _stage++;
         _playerEnergy = PLAYER_ENERGY;
         _enermyEnergy = ENERMY_ENERGY * _stage;
@@ -8,16 +8,52 @@
  *     There are APIs to open, read and write log information to a specified file, “gl.log”.
  *     There are specific APIs for each purpose, such as normal log, error report and from shader program.
  *
+ *     Messages are formatted by the caller into a lock-free ring buffer and written to the file
+ *     by a background thread, so logging never waits on the file system.
+ *     When the ring buffer is full, new messages are dropped and the number of them is reported later.
+ *
+ *     LogDebug messages are compiled in only when LOG_ENABLE_DEBUG is defined.
  */
 namespace gl
 {
+
+/// Log levels
+enum LogLevel
+{
+    LOG_LEVEL_DEBUG = 0,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_ERROR,
+};
+
 /**
  * @brief   Restart the Log file
  *          Open a file named "gl.log" in the same directory with executable file.
  *          This call erases the previous log data and writes current time information.
- *          File handler will be closed internally.
+ *          The file stays open for the background writer until StopLog is called.
  */
 void RestartLog();
+
+/**
+ * @brief   Stop logging
+ *          Write all pending messages, stop the background writer and close the log file.
+ */
+void StopLog();
+
+/**
+ * @brief   Set the lowest level to be logged at run time
+ *
+ * @param level     messages below this level are ignored
+ */
+void SetLogLevel(LogLevel level);
+
+/**
+ * @brief   Write specified message to log file with a log level
+ *          The usage is same with the C default printf function.
+ *
+ * @param level       log level of the message
+ * @param message     format and data
+ */
+void LogMessage(LogLevel level, const char* message, ...);
 
 /**
  * @brief   Write specified message to log file
@@ -38,6 +74,17 @@ void Log(const char* message, ...);
  * @param message     format and data
  */
 void LogError(const char* message, ...);
+
+/**
+ * @brief   Write debug message to log file
+ *          This adds prefix, "[GL DEBUG]" in front of the message when writes.
+ *          Calls are removed at compile time unless LOG_ENABLE_DEBUG is defined.
+ */
+#ifdef LOG_ENABLE_DEBUG
+#define LogDebug(...)   gl::LogMessage(gl::LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LogDebug(...)   ((void)0)
+#endif
 
 /**
  * @brief   Log installed OpenGl Version information and supported renderer's version
@@ -0,0 +1,85 @@
+#ifndef MESH_BVH_H_INCLUDED
+#define MESH_BVH_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace gl
+{
+
+using namespace std;
+
+/**
+ * @brief   A node of a triangle BVH, 32 bytes
+ *          An inner node has its first child right after itself and the second child at "First".
+ *          A leaf node has "Count" triangles starting from "First".
+ */
+struct MeshBvhNode
+{
+    glm::vec3   Min;
+    uint32_t    First;      /// First triangle (leaf) or the second child (inner)
+    glm::vec3   Max;
+    uint32_t    Count;      /// The number of triangles. 0 for an inner node.
+};
+
+/**
+ * @brief   A triangle prepared for the Moller-Trumbore test
+ */
+struct MeshBvhTriangle
+{
+    glm::vec3   V0;
+    glm::vec3   E1;         /// V1 - V0
+    glm::vec3   E2;         /// V2 - V0
+};
+
+/**
+ * @brief   Bounding volume hierarchy over triangles of a mesh in model space
+ *          The tree is built with the surface area heuristic and flattened into one node array.
+ *          Triangles are stored in the leaf order, so the tree does not need vertex or index arrays
+ *          after building and it can be saved and loaded as it is.
+ */
+class MeshBvh
+{
+public:
+    /**
+     * @brief   Build the tree. Large meshes are built by several threads.
+     *
+     * @param positions     Position of the first vertex. Each position is 3 floats.
+     * @param stride        Bytes between positions of two vertices
+     * @param indices       Triangle list indices
+     * @param numIndices    The number of indices
+     * @return  result of method
+     */
+    bool Build(const float* positions, size_t stride, const uint32_t* indices, size_t numIndices);
+
+    /**
+     * @brief   Find the nearest triangle hit by a ray
+     *          The direction does not have to be normalized. The distance is in units of it.
+     *
+     * @param org       Ray origin in model space
+     * @param dir       Ray direction in model space
+     * @param distance  Distance to the nearest hit (Return)
+     * @return  true if any triangle is hit
+     */
+    bool Intersect(const glm::vec3& org, const glm::vec3& dir, float& distance) const;
+
+    /**
+     * @brief   Check the tree can be traversed safely, such as a tree loaded from a cache
+     *          Children and triangles of every node must be in the arrays,
+     *          and the tree must not be deeper than the traversal stack.
+     *
+     * @return  true if the tree is valid
+     */
+    bool IsValid() const;
+
+    bool IsEmpty() const { return Nodes.empty(); }
+
+    vector<MeshBvhNode>     Nodes;
+    vector<MeshBvhTriangle> Triangles;
+};
+
+}   /// namespace gl
+
+#endif // MESH_BVH_H_INCLUDED
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -10,12 +11,15 @@
 
 #include "IGraphicObject.h"
 #include "shader.h"
+#include "meshBvh.h"
 
 namespace gl
 {
 
 using namespace std;
 
+#define MESH_LOD_PIXEL_ERROR    1.f     /// A level is used while its error covers at most this many pixels
+
 struct Vertex
 {
     /// Position
@@ -26,6 +30,18 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+/**
+ * @brief   Compact vertex of 16 bytes, half the size of Vertex
+ *          Position is snorm16 in the bounding box of the mesh, the normal is snorm 10:10:10:2
+ *          and texture coordinates are half floats.
+ */
+struct PackedVertex
+{
+    GLshort     Position[4];    /// xyz and padding
+    GLuint      Normal;         /// GL_INT_2_10_10_10_REV
+    GLushort    TexCoords[2];   /// Half floats
+};
+
 typedef enum TextureType
 {
     Texture_Diffuse,
@@ -39,18 +55,38 @@ struct Texture
     string  path;
 };
 
+/**
+ * @brief   A level of detail of a mesh, a range in the index array
+ *          All levels share the vertices, and coarser levels use fewer of them.
+ */
+struct MeshLod
+{
+    GLuint  FirstIndex;
+    GLuint  IndexCount;
+    GLfloat Error;          /// Simplification error as a distance in model space. 0 for the full detail.
+};
+
+/**
+ * @brief   All data of a mesh.
+ *          This is move-only, so the arrays are never copied on the way from Model to MeshObject.
+ */
 struct MeshData
 {
-    MeshData(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures)
+    MeshData(vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures) :
+        Vertices(std::move(vertices)), Indices(std::move(indices)), Textures(std::move(textures))
     {
-        Vertices = vertices;
-        Indices = indices;
-        Textures = textures;
     }
 
+    MeshData(MeshData&&) = default;
+    MeshData& operator=(MeshData&&) = default;
+    MeshData(const MeshData&) = delete;
+    MeshData& operator=(const MeshData&) = delete;
+
     vector<Vertex>  Vertices;
     vector<GLuint>  Indices;
     vector<Texture> Textures;
+    MeshBvh         Bvh;        /// Triangle BVH for picking
+    vector<MeshLod> Lods;       /// Index ranges from the full detail. Empty for a single level of all indices.
 };
 
 /**
@@ -68,6 +104,7 @@ public:
      * @param vertices      All vertices for this mesh object
      * @param indices       All indices for this mesh object
      * @param textures      All texture information for this mesh object
+     *                      Pass the arrays with std::move to hand them over without copy.
      */
     MeshObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures);
 
@@ -81,6 +118,46 @@ public:
      */
     virtual bool Initialize();
 
+    /**
+     * @brief   Release CPU copies of vertices and indices after "Initialize" uploads them
+     *          Call before "Initialize". Objects needing the arrays later must keep them.
+     *
+     * @param isReleased    true to release arrays after upload
+     */
+    void ReleaseMeshDataAfterUpload(bool isReleased) { _releaseMeshData = isReleased; };
+
+    /**
+     * @brief   Upload vertices as PackedVertex instead of Vertex
+     *          Call before "Initialize". The shader dequantizes positions by "posOffset" and "posScale".
+     *
+     * @param isPacked      true to upload packed vertices
+     */
+    void SetPackedVertex(bool isPacked) { _isPackedVertex = isPacked; };
+
+    /**
+     * @brief   Set a triangle BVH of this mesh for exact picking
+     *          Without it, picking tests the bounding sphere only.
+     *
+     * @param bvh   Triangle BVH built from the vertices and indices of this mesh
+     */
+    void SetBvh(MeshBvh bvh) { _bvh = std::move(bvh); };
+
+    /**
+     * @brief   Set levels of detail in the indices of this mesh
+     *          Call before "Initialize". Without them, all indices are drawn as one level.
+     *
+     * @param lods  Index ranges from the full detail, made by "BuildMeshLods"
+     */
+    void SetLods(vector<MeshLod> lods) { _lods = std::move(lods); };
+
+    /**
+     * @brief   Move this object along its trajectory.
+     *
+     * @param dt        Elapsed time since the previous update in seconds
+     * @param studioEnv Studio environment
+     */
+    virtual void Update(const double dt, StudioEnv& studioEnv);
+
     /**
      * @brief   Draw a frame into a back buffer to display at next frame.
      *
@@ -133,14 +210,67 @@ public:
      */
     void GetCurObjectInfo(struct ObjectInfo& objInfo);
 
+    /**
+     * @brief   Test the bounding sphere of this mesh against the view frustum
+     * @param frustum     View frustum in world space
+     * @return  false if this mesh is not visible
+     */
+    virtual bool CullByFrustum(const Frustum& frustum);
+
+    /**
+     * @brief   Get the bounding sphere of this mesh for picking
+     * @param index       instance index (always 0)
+     * @return center     sphere center in world space
+     * @return radius     sphere radius
+     * @return  result of method
+     */
+    virtual bool GetInstanceBound(uint32_t index, glm::vec3& center, float& radius);
+
 protected:
     bool            SetTextureToShader();
     void            DrawContainer();
 
+    /// Resolve uniform handles from the shader's uniform table
+    virtual void    GetUniformLocations();
+
+    /// Model matrix at the position and the rotation angle
+    glm::mat4       getModelMatrix(glm::vec3 pos, GLfloat angle);
+
+    /// Bounding sphere of the vertices in model space
+    void            calcBoundingSphere();
+
+    /// Quantize vertices and set the dequantization transform
+    void            packVertices(vector<PackedVertex>& packed);
+
+    /// Vertex attributes of the uploaded vertex format
+    void            setupVertexAttributes();
+
+    /// Bounding sphere transformed by a matrix
+    void            transformBoundingSphere(const glm::mat4& mat, glm::vec3& center, GLfloat& radius);
+
+    /// The coarsest level whose error on screen is small enough for a bounding sphere in world space
+    GLuint          selectLod(const glm::vec3& center, GLfloat radius, const StudioEnv& studioEnv);
+
+    /// Byte offset of a level in the ebo
+    GLvoid*         getLodOffset(GLuint lod);
+
     /**  Mesh Data  */
     vector<Vertex>  _vertices;
     vector<GLuint>  _indices;
     vector<Texture> _textures;
+    GLuint          _indexCount;        /// The number of indices of the full detail
+    vector<MeshLod> _lods;              /// Levels of detail. All of them are uploaded to the ebo.
+    GLuint          _curLod;            /// Level drawn by "DrawContainer"
+    GLenum          _indexType;         /// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    bool            _releaseMeshData;   /// Release vertices and indices after upload
+    bool            _isPackedVertex;    /// Vertices are uploaded as PackedVertex
+    glm::vec3       _posOffset;         /// Dequantization of packed positions. Identity for float vertices.
+    glm::vec3       _posScale;
+
+    MeshBvh         _bvh;               /// Triangle BVH in model space
+
+    glm::vec3       _boundCenter;       /// Bounding sphere in model space
+    GLfloat         _boundRadius;
 
     GLuint          _vbo;               /// vertex buffer object
     GLuint          _ebo;               /// element array buffer object
@@ -153,14 +283,30 @@ protected:
 
     Shader*         _pShader;           /// Shader object
 
+    /// Uniform handles resolved once at initialization
+    vector<Uniform> _textureLocs;       /// sampler handle for each texture
+    Uniform         _shininessLoc;
+    Uniform         _lightDiffuseLoc;   /// Studio lights are shared through the StudioEnvBlock
+    Uniform         _lightSpecularLoc;  /// These two only override them for a focused object
+    Uniform         _PVLoc;
+    Uniform         _MLoc;
+    Uniform         _normalMatLoc;
+    Uniform         _posOffsetLoc;
+    Uniform         _posScaleLoc;
+
     glm::vec3       _objectColor;       /// object color
     glm::vec3       _focusColor;        /// focused object color
     glm::vec3       _curPos;
+    glm::vec3       _prevPos;           /// Position at the previous update for render interpolation
+    GLfloat         _angle;             /// Rotation angle in degrees
+    GLfloat         _prevAngle;         /// Rotation angle at the previous update
 
     bool            _isFocused;
     double          _focusedTime;
     const float     FOCUSEDTIME = 0.7f;
 
+    double          _time;              /// Simulation time advanced by "Update"
+
 };
 
 
@@ -0,0 +1,98 @@
+#ifndef MESH_OPTIMIZER_H_INCLUDED
+#define MESH_OPTIMIZER_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+
+#include "meshObject.h"
+
+namespace gl
+{
+
+using namespace std;
+
+#define MESH_OPTIMIZER_CACHE_SIZE   32      /// Simulated vertex cache of the ordering (LRU)
+#define MESH_OPTIMIZER_FIFO_SIZE    16      /// FIFO cache used to measure ACMR
+
+#define MESH_LOD_MAX_LEVELS         4       /// Levels of detail including the full detail
+#define MESH_LOD_REDUCTION          0.3f    /// Target index count of a level relative to the previous one
+#define MESH_LOD_MIN_TRIANGLES      64      /// A level never goes below this
+#define MESH_LOD_MAX_ERROR          0.1f    /// Largest simplification error relative to the bounding radius
+
+/**
+ * @brief   Merge vertices whose position, normal and texture coordinates are all the same
+ *          Indices are remapped to the merged vertices.
+ *
+ * @param vertices      Vertices (Return)
+ * @param indices       Triangle list indices (Return)
+ * @return  the number of vertices after merging
+ */
+uint32_t WeldVertices(vector<Vertex>& vertices, vector<GLuint>& indices);
+
+/**
+ * @brief   Reorder triangles for the post-transform vertex cache
+ *          Tom Forsyth's "Linear-Speed Vertex Cache Optimisation". Triangles are picked greedily
+ *          by scores of their vertices, which favour vertices in the cache and vertices with few triangles left.
+ *
+ * @param indices       Triangle list indices (Return)
+ * @param numVertices   The number of vertices
+ */
+void OptimizeVertexCache(vector<GLuint>& indices, uint32_t numVertices);
+
+/**
+ * @brief   Reorder vertices in the order the triangles first use them, so vertex fetch reads memory forward
+ *          Vertices used by no triangle are dropped.
+ *
+ * @param vertices      Vertices (Return)
+ * @param indices       Triangle list indices (Return)
+ */
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices);
+
+/**
+ * @brief   Average cache miss ratio, the number of transformed vertices per triangle
+ *          0.5 is the best possible for a regular grid, 3 means no reuse at all.
+ *
+ * @param indices       Triangle list indices
+ * @param numVertices   The number of vertices
+ * @param cacheSize     Entries of the simulated FIFO cache
+ * @return  ACMR
+ */
+float CalcAcmr(const vector<GLuint>& indices, uint32_t numVertices, uint32_t cacheSize = MESH_OPTIMIZER_FIFO_SIZE);
+
+/**
+ * @brief   Weld, reorder triangles for the vertex cache and reorder vertices for fetch
+ *          ACMR before and after is logged.
+ *
+ * @param mesh      Mesh to optimize (Return)
+ */
+void OptimizeMesh(MeshData& mesh);
+
+/**
+ * @brief   Simplify a triangle list by edge collapses ordered by quadric error
+ *          Garland and Heckbert's "Surface Simplification Using Quadric Error Metrics".
+ *          A collapse moves a vertex onto one of its neighbours, so no vertex is created
+ *          and the result indexes the same vertices. Vertices on borders and on attribute seams stay.
+ *
+ * @param vertices          Vertices
+ * @param indices           Triangle list indices to simplify
+ * @param targetIndexCount  Stop when the indices are reduced to this
+ * @param maxError          Stop before a collapse whose error is larger than this distance
+ * @param error             Largest error of the collapses done, as a distance in model space (Return)
+ * @return  simplified triangle list indices
+ */
+vector<GLuint> SimplifyMesh(const vector<Vertex>& vertices, const vector<GLuint>& indices,
+                            size_t targetIndexCount, float maxError, float& error);
+
+/**
+ * @brief   Append coarser levels of detail to the indices of a mesh
+ *          Each level is simplified from the previous one and reordered for the vertex cache.
+ *          All levels share the vertices, and their index ranges are recorded in "Lods".
+ *
+ * @param mesh          Mesh whose indices are the full detail (Return)
+ * @param numLevels     The number of levels including the full detail
+ */
+void BuildMeshLods(MeshData& mesh, uint32_t numLevels = MESH_LOD_MAX_LEVELS);
+
+}   /// namespace gl
+
+#endif // MESH_OPTIMIZER_H_INCLUDED
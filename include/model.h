@@ -3,6 +3,7 @@
 
 #include <string>
 #include <vector>
+#include <stdint.h>
 
 #include <GL/glew.h>
 #include <glm/glm.hpp>
@@ -13,11 +14,47 @@
 
 #include "meshObject.h"
 #include "shader.h"
+#include "textureCache.h"
 
 namespace gl {
 
 using namespace std;
 
+#define MESH_CACHE_EXT      ".meshcache"    /// Binary mesh cache is stored next to the model file
+#define MESH_CACHE_MAGIC    0x4853454D      /// "MESH"
+#define MESH_CACHE_VERSION  6               /// Increase when the layout of the cache changes
+
+/**
+ * @brief   Header of a binary mesh cache file
+ *          The header is followed by the source path and all meshes.
+ *          Each mesh is stored as MeshCacheMesh, vertex array, index array, LOD array, its textures,
+ *          BVH node array and BVH triangle array.
+ *          A texture is stored as type, path length and path.
+ */
+struct MeshCacheHeader
+{
+    uint32_t    Magic;
+    uint32_t    Version;
+    uint64_t    SourceSize;     /// Size of the model file
+    int64_t     SourceMtime;    /// Modified time of the model file
+    uint64_t    SourceHash;     /// FNV-1a hash of the model file
+    uint32_t    PathLength;     /// Length of the model file path following this header
+    uint32_t    NumMeshes;
+    uint32_t    IsOptimized;    /// Meshes went through "OptimizeMesh"
+    uint32_t    NumLodLevels;   /// Levels requested from "BuildMeshLods"
+    uint32_t    IsBvhBuilt;     /// Meshes have triangle BVHs
+};
+
+struct MeshCacheMesh
+{
+    uint32_t    NumVertices;
+    uint32_t    NumIndices;
+    uint32_t    NumLods;
+    uint32_t    NumTextures;
+    uint32_t    NumBvhNodes;
+    uint32_t    NumBvhTriangles;
+};
+
 class Model
 {
 public:
@@ -28,25 +65,66 @@ public:
      */
     Model(const char* filePath);
 
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
     /**
      * @brief   Parses all model data from Assimp library
      *          and puts them into internal container
+     *          This does not touch GL, so it can run on a worker thread.
+     *          Textures are loaded here and uploaded later by "UploadTextures".
      * @return  result of method
      */
     bool Parse();
 
     /**
-     * @brief   Return all mesh data
+     * @brief   Weld and reorder meshes for the vertex cache and vertex fetch after parsing
+     *          Call before "Parse". It is enabled by default.
+     *
+     * @param isEnabled     true to optimize meshes
+     */
+    void SetMeshOptimization(bool isEnabled) { _isMeshOptimized = isEnabled; };
+
+    /**
+     * @brief   Set the number of levels of detail built for each mesh after parsing
+     *          Call before "Parse". 1 keeps the full detail only. MESH_LOD_MAX_LEVELS by default.
+     *
+     * @param numLevels     The number of levels including the full detail
+     */
+    void SetLodLevels(uint32_t numLevels) { _numLodLevels = numLevels; };
+
+    /**
+     * @brief   Build triangle BVHs of meshes for picking after parsing
+     *          Call before "Parse". Disable it for a model which is never picked. It is enabled by default.
+     *
+     * @param isEnabled     true to build BVHs
+     */
+    void SetBvhBuild(bool isEnabled) { _isBvhBuilt = isEnabled; };
+
+    /**
+     * @brief   Create texture objects from all decoded images
+     *          Call on the GL thread after "Parse" and before "TakeMeshData".
+     * @return  false if any texture could not be decoded
+     */
+    bool UploadTextures();
+
+    /**
+     * @brief   Hand over all mesh data
+     *          The model does not own the meshes any more after this call.
      * @return  mesh data container
      */
-    vector<MeshData>    GetMeshData();
+    vector<MeshData>    TakeMeshData();
 
 private:
     string              _modelPath;
     vector<MeshData>    _meshes;
+    bool                _isMeshOptimized;
+    uint32_t            _numLodLevels;
+    bool                _isBvhBuilt;
 
     string              _directory;
     vector<Texture>     _texturesCache;
+    vector<TextureImage> _images;           /// Loaded image of each texture in the cache
 
     /**
      * @brief   Processes mesh data at the node and its all children nodes.
@@ -68,6 +146,27 @@ private:
      */
     MeshData parseMeshData(aiMesh* mesh, const aiScene* scene);
 
+    /**
+     * @brief   Loads all meshes from the binary cache of the model file.
+     *          The cache is valid only if it was made from the same model file,
+     *          which is checked with the path, size, modified time and hash of the file.
+     *
+     * @return  true if meshes are loaded from the cache
+     */
+    bool loadMeshCache();
+
+    /**
+     * @brief   Writes all parsed meshes into the binary cache of the model file
+     *
+     * @return  result of method
+     */
+    bool saveMeshCache();
+
+    /**
+     * @brief   Builds triangle BVHs of all parsed meshes
+     */
+    void buildMeshBvh();
+
     /**
      * @brief   Parse Assimp material struct and generates Texture maps
      *
@@ -79,13 +178,22 @@ private:
     bool parseTextures(aiMaterial* mat, aiTextureType type, vector<Texture>& textures);
 
     /**
-     * @brief   Create a texture object to handle the input texture file
+     * @brief   Find a texture in the cache, or load it from file if there is not
      *
-     * @param path          Texture file path
-     * @param directory     Directory the texture file is
-     * @return  Texture object
+     * @param path          Texture file path in the model
+     * @param type          Texture Type
+     * @return  Texture information
+     */
+    Texture getTexture(const char* path, TexType type);
+
+    /**
+     * @brief   Load the input texture file into memory, compressed if possible
+     *
+     * @param path          Texture file path in the model
+     * @param image         Loaded image (Return)
+     * @return  result of method
      */
-    GLint getTextureObjFromFile(const char* path, string directory);
+    bool loadImage(const char* path, TextureImage& image);
 };
 
 }
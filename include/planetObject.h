@@ -18,6 +18,22 @@ namespace gl
 
 using namespace std;
 
+#define DEFAULT_NUM_ASTEROIDS   150     /// The number of asteroid instances
+#define CULL_WORK_GROUP_SIZE    64      /// local_size_x of planetCullCs.glsl
+#define CULL_MAX_LODS           4       /// Should be same with MAX_LODS in planetCullCs.glsl
+
+/**
+ * @brief   Arguments of glDrawElementsIndirect
+ */
+struct DrawElementsIndirectCommand
+{
+    GLuint  Count;
+    GLuint  InstanceCount;
+    GLuint  FirstIndex;
+    GLint   BaseVertex;
+    GLuint  BaseInstance;
+};
+
 /**
  * @brief   Class to manage and draw a mesh object.
  *          This class is the base class of all mesh graphic object.
@@ -33,8 +49,10 @@ public:
      * @param vertices      All vertices for this mesh object
      * @param indices       All indices for this mesh object
      * @param textures      All texture information for this mesh object
+     * @param amount        The number of asteroid instances
      */
-    PlanetObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures);
+    PlanetObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures,
+                 GLuint amount = DEFAULT_NUM_ASTEROIDS);
 
     /**
      * @brief   Destructor of Mesh object
@@ -46,6 +64,16 @@ public:
      */
     virtual bool Initialize();
 
+    /**
+     * @brief   Cull asteroids on GPU with a compute shader instead of CPU.
+     *          Visible asteroids are written into the instance buffer per level of detail and
+     *          drawn by glMultiDrawElementsIndirect, so CPU cost does not depend on the number of asteroids.
+     *          Call before "Initialize". It needs GL 4.3 or ARB_compute_shader.
+     *
+     * @param pCullShader   Compute shader built from planetCullCs.glsl
+     */
+    void SetCullShader(Shader* pCullShader) { _pCullShader = pCullShader; };
+
     /**
      * @brief   Check this object is intersected with the ray
      * @param rayOrg    Ray origin in world space
@@ -55,12 +83,45 @@ public:
      */
     virtual bool IsIntersected(glm::vec3 rayOrg, glm::vec3 rayDir, float *distance){return false;};
 
+    /**
+     * @brief   Asteroids are not picked
+     * @return  false
+     */
+    virtual bool GetInstanceBound(uint32_t index, glm::vec3& center, float& radius){return false;};
+
     /**
      * @brief   Get current information
      * @return objInfo    Current information
      */
     void GetCurObjectInfo(struct ObjectInfo& objInfo);
 
+    /**
+     * @brief   Every asteroid is an instance for collision detection
+     * @return  the number of asteroids
+     */
+    uint32_t GetInstanceCount() { return _modelMatrices ? _amount : 0; }
+
+    /**
+     * @brief   Get the bounding sphere of an asteroid in world space
+     * @param index       asteroid index
+     * @return objInfo    Current information
+     */
+    void GetInstanceInfo(uint32_t index, struct ObjectInfo& objInfo);
+
+    /**
+     * @brief   Asteroids do not move by themselves
+     * @return  true
+     */
+    bool IsStatic() { return true; }
+
+    /**
+     * @brief   Update the transformation of the asteroid field.
+     *
+     * @param dt        Elapsed time since the previous update in seconds
+     * @param studioEnv Studio environment
+     */
+    virtual void Update(const double dt, StudioEnv& studioEnv);
+
     /**
      * @brief   Draw a frame into a back buffer to display at next frame.
      *
@@ -70,10 +131,54 @@ public:
      */
     virtual bool DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv);
 
+    /**
+     * @brief   Collect matrices of asteroids in the view frustum for the next draw
+     * @param frustum     View frustum in world space
+     * @return  false if no asteroid is visible
+     */
+    virtual bool CullByFrustum(const Frustum& frustum);
+
 protected:
-    GLuint          _amount = 150;
+    GLuint          _amount;
     glm::mat4*      _modelMatrices;
 
+    GLuint              _instanceVbo;       /// Instance matrices of visible asteroids
+    vector<GLuint>      _visibleInstances;  /// Visible asteroids collected by "CullByFrustum"
+    vector<glm::mat4>   _visibleMatrices;   /// Matrices of visible asteroids grouped by level of detail
+    vector<GLuint>      _instanceLods;      /// Level of detail of each visible asteroid
+    vector<GLuint>      _lodInstanceCounts; /// Visible asteroids of each level
+
+    /// Bounding spheres of asteroids in world space (center, radius)
+    vector<glm::vec4>   _instanceBounds;
+    glm::vec4           _fieldBound;        /// Bounding sphere of the whole asteroid field
+    glm::mat4           _boundsModelMat;    /// Model matrix the bounding spheres are made with
+
+    void            updateInstanceBounds();
+
+    /// Bucket visible asteroids by level of detail and upload their matrices
+    void            uploadVisibleMatrices(StudioEnv& studioEnv);
+
+    /// Point the instance matrix attributes at an instance of the instance buffer
+    void            setInstanceAttribute(GLuint firstInstance);
+
+    /// For GPU culling
+    Shader*         _pCullShader;       /// Compute shader. CPU culling is used if null.
+    GLuint          _matrixSsbo;        /// All asteroid matrices
+    GLuint          _indirectBuffer;    /// DrawElementsIndirectCommand of each level filled by the compute shader
+    vector<DrawElementsIndirectCommand> _lodCommands;   /// Commands with no instance, to reset the buffer
+    Frustum         _frustum;           /// Frustum of the last "CullByFrustum"
+    bool            _isFieldVisible;
+
+    Uniform         _cullMLoc;
+    Uniform         _cullBoundLoc;
+    Uniform         _cullPlaneLocs[Frustum::NUM_PLANES];
+    Uniform         _cullCountLoc;
+    Uniform         _cullLodErrorLocs[CULL_MAX_LODS];
+    Uniform         _cullLodCountLoc;
+
+    bool            generateCullBuffers();
+    void            cullOnGpu(StudioEnv& studioEnv);
+
     void            DrawContainer();
     bool            generateModelMatrix();
     bool            generateInstanceAttribute();
@@ -0,0 +1,71 @@
+#ifndef RAY_INTERSECT_H_INCLUDED
+#define RAY_INTERSECT_H_INCLUDED
+
+#include <math.h>
+#include <glm/glm.hpp>
+
+namespace gl
+{
+
+/**
+ * @brief   Exact ray and sphere intersection test
+ *          A ray starting inside the sphere hits it at distance 0.
+ *
+ * @param org       Ray origin
+ * @param dir       Normalized ray direction
+ * @param center    Sphere center
+ * @param radius    Sphere radius
+ * @param distance  Distance along the ray to the nearest hit (Return)
+ * @return  true if the ray hits the sphere
+ */
+inline bool IntersectRaySphere(const glm::vec3& org, const glm::vec3& dir,
+                               const glm::vec3& center, float radius, float& distance)
+{
+    glm::vec3 oc = org - center;
+    float b = glm::dot(oc, dir);
+    float c = glm::dot(oc, oc) - radius * radius;
+
+    /// Origin outside and pointing away
+    if(c > 0.f && b > 0.f)
+        return false;
+
+    float discriminant = b * b - c;
+    if(discriminant < 0.f)
+        return false;
+
+    distance = -b - sqrtf(discriminant);
+    if(distance < 0.f)
+        distance = 0.f;
+
+    return true;
+}
+
+/**
+ * @brief   Ray and axis aligned box intersection test (slab method)
+ *
+ * @param org       Ray origin
+ * @param invDir    Reciprocal of the ray direction
+ * @param boxMin    Minimum corner of the box
+ * @param boxMax    Maximum corner of the box
+ * @param maxDist   Hits farther than this are ignored
+ * @param distance  Distance along the ray entering the box (Return)
+ * @return  true if the ray hits the box before maxDist
+ */
+inline bool IntersectRayAabb(const glm::vec3& org, const glm::vec3& invDir,
+                             const glm::vec3& boxMin, const glm::vec3& boxMax, float maxDist, float& distance)
+{
+    glm::vec3 t0 = (boxMin - org) * invDir;
+    glm::vec3 t1 = (boxMax - org) * invDir;
+    glm::vec3 tNear = glm::min(t0, t1);
+    glm::vec3 tFar = glm::max(t0, t1);
+
+    float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+    float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, maxDist));
+
+    distance = enter;
+    return enter <= exit;
+}
+
+}   /// namespace gl
+
+#endif // RAY_INTERSECT_H_INCLUDED
@@ -52,6 +52,11 @@ public:
      */
     virtual bool DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv);
 
+protected:
+    /// Resolve uniform handles from the shader's uniform table
+    virtual void GetUniformLocations();
+
+    Uniform     _objColorLoc;
 };
 }  /// namespace gl
 
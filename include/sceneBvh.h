@@ -0,0 +1,93 @@
+#ifndef SCENE_BVH_H_INCLUDED
+#define SCENE_BVH_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "IGraphicObject.h"
+
+namespace gl
+{
+
+using namespace std;
+
+/**
+ * @brief   An entry of the scene BVH, one instance of an object
+ */
+struct SceneBvhItem
+{
+    IGraphicObject* Obj;
+    uint32_t        Index;      /// Instance index in the object
+    glm::vec3       Min;        /// Bounds of the instance
+    glm::vec3       Max;
+    glm::vec3       Center;
+};
+
+/**
+ * @brief   A node of the scene BVH
+ *          An inner node has its first child right after itself and the second child at "First".
+ *          A leaf node has "Count" items starting from "First".
+ */
+struct SceneBvhNode
+{
+    glm::vec3       Min;
+    glm::vec3       Max;
+    uint32_t        First;      /// First item (leaf) or the second child (inner)
+    uint32_t        Count;      /// The number of items. 0 for an inner node.
+};
+
+/**
+ * @brief   Result of a ray cast
+ */
+struct SceneBvhHit
+{
+    IGraphicObject* Obj;
+    uint32_t        Index;      /// Instance index in the object
+    float           Distance;
+};
+
+/**
+ * @brief   Bounding volume hierarchy over all pickable instances in a studio
+ *          Instances report their bounding sphere by "IGraphicObject::GetInstanceBound".
+ *          The tree is built once and refitted afterwards. It is rebuilt when the set of
+ *          instances changes or refitting has loosened the tree too much.
+ */
+class SceneBvh
+{
+public:
+    SceneBvh();
+
+    /**
+     * @brief   Refit the tree with current bounds of all instances
+     *
+     * @param objs      All objects in a studio
+     */
+    void Update(const vector<IGraphicObject*>& objs);
+
+    /**
+     * @brief   Find the nearest instance hit by a ray
+     *          Candidates are tested exactly by "IGraphicObject::IsInstanceIntersected".
+     *
+     * @param org       Ray origin in world space
+     * @param dir       Normalized ray direction in world space
+     * @param hit       The nearest hit (Return)
+     * @return  true if any instance is hit
+     */
+    bool Cast(glm::vec3 org, glm::vec3 dir, SceneBvhHit& hit);
+
+private:
+    vector<SceneBvhItem>    _items;
+    vector<SceneBvhNode>    _nodes;
+    float                   _builtArea;     /// Sum of node surface areas when built
+    uint32_t                _numInstances;  /// The number of all instances when built
+
+    void        collectItems(const vector<IGraphicObject*>& objs);
+    void        build();
+    uint32_t    buildNode(uint32_t first, uint32_t count);
+    float       refit();
+};
+
+}   /// namespace gl
+
+#endif // SCENE_BVH_H_INCLUDED
@@ -2,28 +2,101 @@
 #define SHADER_H_INCLUDED
 
 #define GLEW_NO_GLU
+#include <stdint.h>
 #include <string>
+#include <map>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
 
 namespace gl
 {
 
+using namespace std;
+
+#define SHADER_NUM_STAGES       5               /// Vertex (or compute), fragment, tessellation control, evaluation, geometry
+#define SHADER_CACHE_DIR        "./cache"       /// Linked program binaries are stored here
+#define SHADER_CACHE_EXT        ".progbin"
+#define SHADER_CACHE_MAGIC      0x52444853      /// "SHDR"
+#define SHADER_CACHE_VERSION    1               /// Increase when the layout of the cache changes
+
+/**
+ * @brief   Header of a program binary cache file. The binary follows it.
+ */
+struct ShaderCacheHeader
+{
+    uint32_t    Magic;
+    uint32_t    Version;
+    uint64_t    Key;            /// Hash of all stage sources and the driver strings
+    uint32_t    Format;         /// Binary format from glGetProgramBinary
+    uint32_t    Length;         /// Bytes of the binary
+};
+
+/**
+ * @brief Handle of a uniform variable in a program object.
+ *        Handles are resolved from the uniform table built at link time,
+ *        so drawing through a handle never queries the location by name.
+ *        Setting a value through an invalid handle (inactive uniform) is ignored.
+ */
+struct Uniform
+{
+    GLint   Loc = -1;
+
+    bool IsValid() const { return Loc > -1; }
+
+    void Set(GLint value) const { if(Loc > -1) glUniform1i(Loc, value); }
+    void Set(GLfloat value) const { if(Loc > -1) glUniform1f(Loc, value); }
+    void Set(const glm::vec3& value) const { if(Loc > -1) glUniform3fv(Loc, 1, &value.x); }
+    void Set(const glm::vec4& value) const { if(Loc > -1) glUniform4fv(Loc, 1, &value.x); }
+    void Set(const glm::mat3& value) const { if(Loc > -1) glUniformMatrix3fv(Loc, 1, GL_FALSE, &value[0][0]); }
+    void Set(const glm::mat4& value) const { if(Loc > -1) glUniformMatrix4fv(Loc, 1, GL_FALSE, &value[0][0]); }
+};
+
+typedef enum {
+    Shader_Created,         /// Nothing is compiled yet
+    Shader_Submitted,       /// Compiling and linking may still run in the driver
+    Shader_Ready,
+    Shader_Failed
+} ShaderState;
+
 /**
  * @brief Class for a shader object.
  *        An object contains a program object.
- *        The program object is constructed at "Initialize" method.
- *        So, before using the program by calling "Use" method, "Initialize" should be called.
+ *        The program object is constructed at "Initialize" method, or by "Submit" and "Finish".
+ *        "Submit" only starts compiling, so that all programs are compiled together.
+ *        "Use" and "GetUniform" finish a submitted program at the first call.
  *
  */
 class Shader
 {
     GLuint        _program;
+    ShaderState   _state;
     const GLchar* _vertexPath;
     const GLchar* _fragmentPath;
     const GLchar* _tcsPath;         /// Tessellation Control Shader path
     const GLchar* _tesPath;         /// Tessellation Evaluation Shader path
     const GLchar* _gsPath;          /// Geometry Shader path
+    const GLchar* _csPath;          /// Compute Shader path
+
+    map<string, GLint>  _uniforms;  /// Uniform name to location table of the linked program
+
+    /// Reflects all active uniforms of the linked program into the uniform table
+    void buildUniformTable();
+
+    /// Sources and shader objects from "Submit" to "Finish"
+    string        _sources[SHADER_NUM_STAGES];
+    GLuint        _stages[SHADER_NUM_STAGES];
+
+    /// Program binary cache. A cached binary is used only if the sources and the driver are the same.
+    bool          _isBinarySupported;
+    bool          _isCached;        /// The program is loaded from a binary instead of compiling
+    uint64_t      _cacheKey;
+    bool loadProgramBinary(uint64_t key);
+    void saveProgramBinary(uint64_t key);
+
+    /// Compile all stages and link without waiting for the result
+    void submitStages();
+    void releaseStages();
 
 public:
     /**
@@ -34,8 +107,20 @@ public:
      */
     Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* tcsPath = nullptr
            , const GLchar* tesPath = nullptr, const GLchar* gsPath = nullptr)
-            : _vertexPath(vertexPath), _fragmentPath(fragmentPath),
-                _tcsPath(tcsPath), _tesPath(tesPath), _gsPath(gsPath) {};
+            : _program(0), _state(Shader_Created), _vertexPath(vertexPath), _fragmentPath(fragmentPath),
+                _tcsPath(tcsPath), _tesPath(tesPath), _gsPath(gsPath), _csPath(nullptr),
+                _stages(), _isBinarySupported(false), _isCached(false), _cacheKey(0) {};
+
+    /**
+     * @brief   Constructor of compute Shader object
+     *          A compute program has no other stages. It needs GL 4.3 or ARB_compute_shader.
+     *
+     * @param computePath    Compute shader source code file path
+     */
+    explicit Shader(const GLchar* computePath)
+            : _program(0), _state(Shader_Created), _vertexPath(nullptr), _fragmentPath(nullptr),
+                _tcsPath(nullptr), _tesPath(nullptr), _gsPath(nullptr), _csPath(computePath),
+                _stages(), _isBinarySupported(false), _isCached(false), _cacheKey(0) {};
 
     /**
      * @brief   Destructor of Shader object
@@ -49,11 +134,39 @@ public:
     /**
      * @brief   Construct a program object.
      *          Build and compile the vertex shader and the fragment shader and makes program object.
+     *          A linked program is saved in SHADER_CACHE_DIR and loaded instead of compiling next time,
+     *          while the sources and the driver stay the same.
      *
      * @return  result of method
      */
     bool Initialize();
 
+    /**
+     * @brief   Read sources and start compiling and linking the program.
+     *          This does not wait for the driver. A cached binary is loaded instead if there is.
+     *          Enable parallel compiling (glMaxShaderCompilerThreadsARB) before submitting
+     *          all programs to compile them at the same time.
+     *
+     * @return  false if a source cannot be read
+     */
+    bool Submit();
+
+    /**
+     * @brief   Wait for the submitted program and check the result.
+     *          This builds the uniform table and stores the program binary cache.
+     *
+     * @return  result of compiling and linking
+     */
+    bool Finish();
+
+    /**
+     * @brief   Check the submitted program is compiled and linked without waiting.
+     *          Without parallel compiling, "Finish" may wait and this is always true.
+     *
+     * @return  true if "Finish" will not wait for the driver
+     */
+    bool IsCompleted();
+
     /**
      * @brief   Get Shader program object
      *
@@ -61,11 +174,25 @@ public:
      */
     const GLuint GetProgram() { return _program; };
 
+    /**
+     * @brief   Get a handle of a uniform variable from the uniform table.
+     *          The table is built once when the program is linked, so this does not touch GL
+     *          except finishing a submitted program at the first call.
+     *          Resolve handles at initialization time and keep them for drawing.
+     *
+     * @param name  Uniform name, such as "viewPos" or "pointLights[0].position"
+     * @return  Uniform handle. It is invalid if the uniform is not active in the program.
+     */
+    Uniform GetUniform(const string& name);
+
     /**
      * @brief   Uses the current shader
+     *          A submitted program is finished at the first use.
      */
     void Use()
     {
+        if(_state != Shader_Ready)
+            Finish();
         glUseProgram(this->_program);
     }
 };
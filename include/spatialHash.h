@@ -0,0 +1,132 @@
+#ifndef SPATIAL_HASH_H_INCLUDED
+#define SPATIAL_HASH_H_INCLUDED
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "IGraphicObject.h"
+
+namespace gl
+{
+
+using namespace std;
+
+#define SPATIAL_HASH_CELL_SIZE      4.0f    /// Edge length of a grid cell in world units
+#define SPATIAL_HASH_NUM_BUCKETS    4096    /// Hash table size. Must be a power of 2.
+#define SPATIAL_HASH_MAX_CELLS      64      /// Instances covering more cells are kept out of the grid
+
+/// Query mask bit of an object type
+#define SPATIAL_MASK(type)          (1u << (type))
+
+/**
+ * @brief   An instance in the spatial hash
+ */
+struct SpatialHashProxy
+{
+    IGraphicObject* Obj;
+    uint32_t        Index;      /// Instance index in the object
+    uint32_t        Mask;       /// SPATIAL_MASK of the object type
+    glm::vec3       Center;     /// Bounding sphere in world space
+    float           Radius;
+    glm::ivec3      CellMin;    /// Cells covered by the bounding sphere
+    glm::ivec3      CellMax;
+    bool            IsLarge;    /// Kept in the large list instead of the grid
+    uint32_t        Stamp;      /// The last query which visited this proxy
+};
+
+/**
+ * @brief   Overlapping instances found by a query
+ */
+struct SpatialHashPair
+{
+    const SpatialHashProxy* A;
+    const SpatialHashProxy* B;
+};
+
+/**
+ * @brief   Broadphase collision detection over bounding spheres of all instances in a studio
+ *          Space is split into uniform cells and each cell is hashed into a fixed size bucket table,
+ *          so the grid is unbounded without allocating every cell.
+ *          Instances report their bounding sphere by "IGraphicObject::GetInstanceInfo".
+ *          Only instances whose cells changed since the previous update are moved between buckets,
+ *          and instances of static objects are inserted once.
+ */
+class SpatialHash
+{
+public:
+    /**
+     * @brief   Constructor of SpatialHash object
+     *
+     * @param cellSize  Edge length of a cell. About twice the radius of common instances works best.
+     */
+    explicit SpatialHash(float cellSize = SPATIAL_HASH_CELL_SIZE);
+
+    /**
+     * @brief   Refresh bounds of all instances
+     *          Everything is inserted again when objects or instances are added or removed.
+     *
+     * @param objs      All objects in a studio
+     */
+    void Update(const vector<IGraphicObject*>& objs);
+
+    /**
+     * @brief   Remove all instances. The next "Update" inserts them again.
+     */
+    void Clear();
+
+    /**
+     * @brief   Find instances overlapping a sphere, such as the camera
+     *
+     * @param center    Sphere center in world space
+     * @param radius    Sphere radius
+     * @param mask      SPATIAL_MASK of object types to find
+     * @param hits      Overlapping instances. Valid until the next "Update". (Return)
+     * @return  the number of overlapping instances
+     */
+    uint32_t Query(glm::vec3 center, float radius, uint32_t mask, vector<const SpatialHashProxy*>& hits);
+
+    /**
+     * @brief   Find overlapping pairs of instances between two groups of object types
+     *          Every instance in the first group queries the second one. An instance never pairs with itself,
+     *          and a pair is reported once when both groups share a type, so bomb-vs-bomb is "QueryPairs(bomb, bomb)".
+     *          Pairs of one instance are reported in a row.
+     *
+     * @param maskA     SPATIAL_MASK of object types in the first group, such as bombs
+     * @param maskB     SPATIAL_MASK of object types in the second group, such as asteroids
+     * @param pairs     Overlapping pairs. "A" is in the first group. (Return)
+     * @return  the number of overlapping pairs
+     */
+    uint32_t QueryPairs(uint32_t maskA, uint32_t maskB, vector<SpatialHashPair>& pairs);
+
+private:
+    /// Instances of an object are stored in a row
+    struct ObjectRange
+    {
+        IGraphicObject* Obj;
+        uint32_t        Mask;
+        uint32_t        First;
+        uint32_t        Count;
+        bool            IsStatic;
+    };
+
+    float                       _cellSize;
+    vector<SpatialHashProxy>    _proxies;
+    vector<ObjectRange>         _ranges;
+    vector<vector<uint32_t>>    _buckets;       /// Proxy indices in each bucket
+    vector<uint32_t>            _largeProxies;  /// Proxies tested by every query
+    vector<uint32_t>            _candidates;
+    uint32_t                    _stamp;
+
+    void        rebuild(const vector<IGraphicObject*>& objs);
+    void        setBound(uint32_t proxyIndex, glm::vec3 center, float radius);
+    void        insert(uint32_t proxyIndex);
+    void        remove(uint32_t proxyIndex);
+    void        gather(glm::vec3 center, float radius, uint32_t mask);
+    glm::ivec3  cellOf(glm::vec3 pos) const;
+    uint32_t    bucketOf(int32_t x, int32_t y, int32_t z) const;
+};
+
+}   /// namespace gl
+
+#endif // SPATIAL_HASH_H_INCLUDED
@@ -1,6 +1,7 @@
 #ifndef SPHERE_H_INCLUDED
 #define SPHERE_H_INCLUDED
 
+#include <vector>
 #define GLEW_NO_GLU
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -13,12 +14,38 @@ namespace gl
 
 using namespace std;
 
+#define SPHERE_TESS_PIXELS      8.f     /// Target length of a tessellated edge on screen
+#define SPHERE_MAX_TESS_LEVEL   16.f    /// Level of the nearest spheres
+#define SPHERE_ICO_LEVELS       4       /// Icospheres of 1 to 4 subdivisions for SphereRender_Icosphere
+
+#define SPHERE_RENDER_ENV       "PLAYGROUND_SPHERE_RENDER"  /// "tessellation" or "icosphere" skips the probe
+
 /**
- * @brief   Class to manage and draw a sphere object.
+ * @brief   How spheres are drawn
+ */
+typedef enum SphereRenderPath
+{
+    SphereRender_Auto,              /// Decided by "ChooseRenderPath"
+    SphereRender_Tessellation,      /// Icosahedron patches tessellated on GPU (sphereVs, Tcs, Tes, Fs)
+    SphereRender_Icosphere          /// Precomputed icospheres with plain instanced shaders (sphereIcoVs, sphereFs)
+} SphereRenderPath;
+
+/**
+ * @brief   Per instance attributes of a sphere uploaded into the instance buffer.
+ */
+struct SphereInstance
+{
+    glm::vec4   PosScale;           /// xyz : position in world space, w : scale
+    glm::vec4   Color;              /// rgb : object color
+};
+
+/**
+ * @brief   Class to manage and draw sphere objects (bombs).
  *          This class inherits the Triangle class because a cube is a composition of multiple triangles.
  *          So, all implementation is same with triangle class except how to draw for the next frame.
- *          In this version, the internal implementation has upgraded to support multiple objects and
- *          Element Buffer Objects.
+ *          One object manages multiple spheres. The status of every sphere is kept in contiguous arrays
+ *          and all spheres are drawn with a single instanced draw call.
+ *          Each sphere is accessible as an instance of this object.
  *
  */
 class SphereObject : public TriangleObject
@@ -30,22 +57,56 @@ public:
      *
      * @param pShader       Shader Object to be used
      * @param texturePath   Texture file path to wrap this object
+     * @param count         The number of spheres
      */
-    SphereObject(Shader* pShader, const char* texturePath);
+    SphereObject(Shader* pShader, const char* texturePath, GLuint count = 1);
 
     /**
      * @brief   Constructor of Sphere object
      *
      * @param pShader       Shader Object to be used
      * @param objectColor   The color of this object
+     * @param count         The number of spheres
      */
-    SphereObject(Shader* pShader, glm::vec3 objectColor);
+    SphereObject(Shader* pShader, glm::vec3 objectColor, GLuint count = 1);
 
     /**
      * @brief   Destructor of Sphere object
      */
     virtual ~SphereObject();
 
+    /**
+     * @brief   Choose how spheres are drawn on the current GL context
+     *          SphereRender_Auto looks at SPHERE_RENDER_ENV first, and then probes the context.
+     *          Icospheres are chosen without tessellation support or on a software rasterizer,
+     *          where tessellation runs very slowly.
+     *
+     * @param requested     Path from the configuration
+     * @return  the path to draw with. Never SphereRender_Auto.
+     */
+    static SphereRenderPath ChooseRenderPath(SphereRenderPath requested = SphereRender_Auto);
+
+    /**
+     * @brief   Set how spheres are drawn
+     *          Call before "Initialize" with a shader built for the path. Tessellation by default.
+     *
+     * @param path      SphereRender_Tessellation or SphereRender_Icosphere
+     */
+    void SetRenderPath(SphereRenderPath path) { _renderPath = path; };
+
+    /**
+     * @brief   Initialize all processes before draw an object
+     */
+    virtual bool Initialize();
+
+    /**
+     * @brief   Move all spheres and reset spheres which are passed, shot or expired.
+     *
+     * @param dt        Elapsed time since the previous update in seconds
+     * @param studioEnv Studio environment
+     */
+    virtual void Update(const double dt, StudioEnv& studioEnv);
+
     /**
      * @brief   Draw a frame into a back buffer to display at next frame.
      *
@@ -58,6 +119,7 @@ public:
 
     /**
      * @brief   Check this object is intersected with the ray
+     *          The nearest intersected sphere is remembered and "Focus" is applied to it.
      * @param rayOrg    Ray origin in world space
      * @param rayDir    Ray direction in world space
      * @return  distance    distance from ray when the object is intersected
@@ -66,45 +128,142 @@ public:
     bool IsIntersected(glm::vec3 rayOrg, glm::vec3 rayDir, float *distance);
 
     /**
-     * @brief   Reset Internal status
+     * @brief   Mark spheres in the view frustum to be drawn in the next frame
+     * @param frustum     View frustum in world space
+     * @return  false if no sphere is visible
+     */
+    virtual bool CullByFrustum(const Frustum& frustum);
+
+    /**
+     * @brief   Get the bounding sphere of a sphere for picking
+     * @param index       sphere index
+     * @return center     sphere center in world space
+     * @return radius     sphere radius
+     * @return  result of method
+     */
+    bool GetInstanceBound(uint32_t index, glm::vec3& center, float& radius);
+
+    /**
+     * @brief   Check a sphere is intersected with the ray
+     * @param index     sphere index
+     * @param rayOrg    Ray origin in world space
+     * @param rayDir    Normalized ray direction in world space
+     * @return  distance    distance from ray origin when the sphere is intersected
+     * @return  result of method
+     */
+    bool IsInstanceIntersected(uint32_t index, glm::vec3 rayOrg, glm::vec3 rayDir, float *distance);
+
+    /**
+     * @brief   Update focus status of a sphere
+     * @param index        sphere index
      * @param isFocused    set current status if this is focused or not
      * @param focusColor   focus color;
      */
+    void FocusInstance(uint32_t index, bool isFocused, glm::vec3 focusColor = glm::vec3(0));
+
+    /**
+     * @brief   Update focus status of the sphere found by the last "IsIntersected"
+     * @param isFocused    set current status if this is focused or not
+     * @param focusColor   focus color;
+     */
+    void Focus(bool isFocused, glm::vec3 focusColor = glm::vec3(0));
+
+    /**
+     * @brief   Reset Internal status of all spheres
+     * @param studioEnv    Studio environment
+     */
     void Reset(StudioEnv& studioEnv);
 
+    /**
+     * @brief   Get current information of the sphere found by the last "IsIntersected" or the first sphere
+     * @return objInfo    Current information
+     */
+    void GetCurObjectInfo(struct ObjectInfo& objInfo);
+
+    /**
+     * @brief   Get the number of spheres
+     * @return  the number of spheres
+     */
+    uint32_t GetInstanceCount() { return _count; }
+
+    /**
+     * @brief   Get current information of a sphere
+     * @param index       sphere index
+     * @return objInfo    Current information
+     */
+    void GetInstanceInfo(uint32_t index, struct ObjectInfo& objInfo);
+
+    /**
+     * @brief   Reset Internal status of a sphere
+     * @param index       sphere index
+     * @param studioEnv   Studio environment
+     */
+    void ResetInstance(uint32_t index, StudioEnv& studioEnv);
+
 protected:
     void        DrawContainer();
 
-    glm::mat4   _modelMat;
+    /// Point the instance attributes at an instance of the instance buffer
+    void        setInstanceAttribute(GLuint firstInstance);
+
+    /// Resolve uniform handles from the shader's uniform table
+    virtual void GetUniformLocations();
 
 private:
-    /// The location of uniform variables related with light calculation
-    GLint _lightPosLoc;
-    GLint _viewPosLoc;
-    GLint _lightColorLoc;
-    GLint _objectColorLoc;
-    /// The location of uniform variables related with PVM calculation
-    GLint _PVLoc;
-    GLint _MLoc;
-    GLint _normalMatLoc;
-    GLint _seedNum;
-
-    glm::vec3 _movingDistance;
-    glm::vec3 _movement;
-    double _focusedTime;
-    double _startTime;
-    /// Get Uniform locations
-    void GetUniformLocations();
-
-    /// decide moving distance of this object
-    glm::vec3 decideMovingDistance(StudioEnv& studioEnv);
+    /// The location of uniform variables related with PV calculation
+    /// ( Studio lights are shared through the StudioEnvBlock uniform buffer )
+    Uniform _PVLoc;
+
+    /// Tessellation levels and patch culling in the TCS
+    Uniform _frustumPlaneLocs[Frustum::NUM_PLANES];
+    Uniform _tessPixelsLoc;
+    Uniform _maxTessLevelLoc;
+    Frustum _frustum;                   /// Frustum of the last "CullByFrustum"
+
+    /// Status of all spheres. Every array has "_count" elements.
+    GLuint              _count;
+    vector<glm::vec3>   _orgPositions;
+    vector<glm::vec3>   _positions;
+    vector<glm::vec3>   _prevPositions; /// Positions at the previous update for render interpolation
+    vector<glm::vec3>   _movingDistances;   /// Moving distance per second
+    vector<glm::vec3>   _movements;
+    vector<glm::vec3>   _colors;
+    vector<GLubyte>     _focused;
+    vector<double>      _focusedTimes;
+    vector<double>      _startTimes;
+    vector<GLint>       _seedNums;
+
+    vector<GLubyte>     _visible;       /// Spheres in the view frustum, marked by "CullByFrustum"
+
+    vector<SphereInstance>  _instances; /// Instance buffer data
+    GLuint              _drawCount;     /// The number of instances packed for the draw
+    GLuint              _instanceVbo;   /// Instance buffer object
+    GLint               _hitIndex;      /// The sphere found by the last "IsIntersected"
+
+    /// For the icosphere path
+    SphereRenderPath    _renderPath;
+    vector<GLfloat>     _icoVertices;   /// Same layout as the icosahedron. Released after upload.
+    vector<GLuint>      _icoIndices;    /// All levels from the coarsest. Released after upload.
+    GLuint              _icoFirstIndex[SPHERE_ICO_LEVELS];
+    GLuint              _icoIndexCount[SPHERE_ICO_LEVELS];
+    GLuint              _levelCounts[SPHERE_ICO_LEVELS];    /// Packed instances of each level
+    vector<GLuint>      _instanceLevels;
+    vector<SphereInstance>  _sortedInstances;
+
+    /// Subdivide the icosahedron into all icosphere levels, sharing one vertex array
+    void buildIcospheres();
+    /// The coarsest level whose edges are not longer than SPHERE_TESS_PIXELS on screen
+    GLuint selectIcoLevel(const glm::vec4& posScale, StudioEnv& studioEnv);
+    /// Group packed instances by icosphere level
+    void sortByIcoLevel(StudioEnv& studioEnv);
+
+    /// decide moving distance of a sphere
+    glm::vec3 decideMovingDistance(GLuint index, StudioEnv& studioEnv);
     /// decide random object color
-    glm::vec3 decideObjectColor(StudioEnv& studioEnv);
-    /// reset values
-    void reset(StudioEnv& studioEnv);
+    glm::vec3 decideObjectColor(GLuint index, StudioEnv& studioEnv);
     bool _isFirstRendering = true;
 
-    const float DEFAULT_MOVING_DISTANCE = 0.10f;
+    const float DEFAULT_MOVING_DISTANCE = 6.0f;    /// per second
     const float FOCUSEDTIME = 0.3f;
 };
 }  /// namespace gl
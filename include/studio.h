@@ -5,9 +5,9 @@
 #include <vector>
 #include <glm/glm.hpp>
 #define GLEW_NO_GLU
-#include <GL/glew.h>
+#include <GL/glew.h>
 #include <GLFW/glfw3.h>
-
+
 #include "camera.h"
 #include "IGraphicObject.h"
 #include "windowManager.h"
@@ -15,11 +15,17 @@
 #include "textRenderer.h"
 #include "gameControl.h"
 #include "studioEnv.h"
+#include "sceneBvh.h"
+#include "spatialHash.h"
+#include "assetLoader.h"
+#include "sphereObject.h"
 
 namespace gl
 {
 using namespace std;
 
+struct MeshData;
+
 /**
  * @brief   Struct to contain commands from a director ( Keyboard or mouse input )
  */
@@ -36,6 +42,14 @@ typedef struct command
 
 
 #define SHADER_NUM  2
+#define NUM_BOMBS   10      /// The number of bombs on stage
+
+#define SIM_STEP        (1.0 / 120.0)   /// Fixed simulation time step in seconds
+#define MAX_FRAME_TIME  0.25            /// Longest frame time fed into the simulation at once
+
+#define CAMERA_RADIUS   2.0f            /// Objects closer to the camera than this hit the player
+
+#define ASSET_UPLOAD_BUDGET 0.004       /// Seconds of GL uploads per frame while loading
 
 /**
  * @brief   Class to manage all graphics objects and to show output onto the requested window.
@@ -60,10 +74,28 @@ class Studio
     bool        _firstMouse = true;
     GLfloat     _prevX, _prevY;
     GLfloat     _deltaTime = 0.0f;
-    GLfloat     _lastRenderTime = 0.0f;
+    double      _lastRenderTime = 0.0;
+
+    /// For fixed time step simulation
+    double      _simAccumulator = 0.0;  /// Frame time not simulated yet
+    GLfloat     _maxFrameRate = 0.0f;   /// 0 means no limit
+
+    /// How bombs are drawn. Auto is decided by SphereObject::ChooseRenderPath in "Ready".
+    SphereRenderPath    _bombRenderPath = SphereRender_Auto;
+
+    /// Advance the simulation by a fixed step
+    void simulate(const double dt);
 
     /// Studio environment
     StudioEnv   _studioEnv;
+    GLuint      _envUbo;            /// uniform buffer object for StudioEnvBlock
+
+    /// For picking
+    SceneBvh    _sceneBvh;          /// BVH over all pickable instances
+    bool        _isBvhDirty;        /// Objects moved after the last refit
+
+    /// Upload the studio environment into the shared uniform buffer once per frame
+    void updateEnvBlock(StudioEnv& studioEnv);
 
     /// Players
     vector<IGraphicObject*> _objs;
@@ -75,17 +107,51 @@ class Studio
     /// Shader
     vector<Shader*> _shaders;
 
+    /// For loading
+    AssetLoader             _assetLoader;
+    bool                    _isLoaded;          /// All assets are uploaded and the simulation runs
+    TextLayout              _loadingText;
+    unsigned                _numLoadingDone;    /// Finished jobs the loading text is made with
+
+    /// Parse a model on a worker and make an object of each mesh on the GL thread, one per upload step
+    /// Triangle BVHs are built only for a model which is picked
+    /// Objects are made after the driver compiled all the programs they use, so the loading frame does not wait
+    void submitModel(const char* path, bool isPicked, vector<Shader*> shaders, function<IGraphicObject*(MeshData&)> makeObject);
+
+    /// Finish programs whose parallel compiling is done, without waiting for the others
+    bool finishCompiledShaders();
+
+    /// Progress shown instead of the stage until all assets are loaded
+    void displayLoading(StudioEnv& studioEnv);
+
+    /// simulation of all objects ( no GL calls )
+    void updateObjects(const double dt, StudioEnv& studioEnv);
+
     /// rendering
-    void renderNextFrame(const double time, glm::mat4 matrix, StudioEnv& studioEnv);
+    void renderNextFrame(const double time, glm::mat4 matrix, const Frustum& frustum, StudioEnv& studioEnv);
 
     /// Objects rearrangement based on current status
     void checkObjectsOnStage(StudioEnv& studioEnv);
+
+    /// For collision detection
+    SpatialHash                     _broadphase;        /// Bounding spheres of all instances
+    vector<const SpatialHashProxy*> _collisionHits;
+    vector<SpatialHashPair>         _collisionPairs;
     /// Command
     Command     _command;
 
     /// For game
     GameControl             _gameControl;
     void displayGameStatus(const double time, glm::mat4 matrix, StudioEnv& studioEnv);
+
+    /// HUD text
+    TextLayout              _gameOverText;
+    TextLayout              _stageText;
+    TextLayout              _damagedText;
+    TextLayout              _shotText;
+    TextLayout              _statusText;
+    unsigned                _statusVersion;     /// GameControl status the HUD text is made with. ~0 before the first.
+    void updateStatusText();
     void ProcessKeyCommand();
     void ProcessMouseCommand();
     void ProcessFrameChangeCommand();
@@ -137,6 +203,27 @@ public:
         _studioEnv.LightPos = lightPos;
     };
 
+    /**
+     * @brief   Frame rate setting in this studio object
+     *          The simulation runs at a fixed rate (SIM_STEP) whatever the frame rate is.
+     *
+     * @param maxFrameRate  maximum frames per second. 0 means no limit.
+     */
+    void FrameRateSetting(GLfloat maxFrameRate) {
+        _maxFrameRate = maxFrameRate;
+    };
+
+    /**
+     * @brief   Bomb rendering setting in this studio object
+     *          Call before "Ready". SphereRender_Auto picks a path from SPHERE_RENDER_ENV
+     *          or from the capabilities of the GL context.
+     *
+     * @param path      How bombs are drawn
+     */
+    void BombRenderSetting(SphereRenderPath path) {
+        _bombRenderPath = path;
+    };
+
     void Shoot();
 };
 
@@ -4,6 +4,10 @@
 #include <glm/glm.hpp>
 
 #define NUM_POINT_LIGHTS    6
+#define MAX_POINT_LIGHTS    16      /// Should be same with MAX_POINT_LIGHTS in shaders
+
+#define STUDIO_ENV_BLOCK    "StudioEnvBlock"    /// Uniform block name in shaders
+#define STUDIO_ENV_BINDING  0                   /// Uniform buffer binding point of the block
 
 struct StudioEnv
 {
@@ -14,8 +18,10 @@ struct StudioEnv
     glm::vec3   ViewPos;
     glm::vec3   PlayerPos;
     glm::vec2   ScreenSize;
+    float       ProjScale;          /// Pixels covered by a unit length at distance 1, for LOD selection
     glm::vec3   Front;
-    glm::vec3   PointLightPos[NUM_POINT_LIGHTS] = {
+    int         NumPointLights = NUM_POINT_LIGHTS;
+    glm::vec3   PointLightPos[MAX_POINT_LIGHTS] = {
         glm::vec3( 20.f,  0.f,  0.f),
         glm::vec3(-20.f,  0.f,  0.f),
         glm::vec3(  0.f, 20.f,  0.f),
@@ -25,6 +31,26 @@ struct StudioEnv
     };
 
     int         GameStage;
+
+    float       RenderAlpha = 1.f;  /// Interpolation factor between the previous and the current simulation step
+};
+
+/**
+ * @brief   std140 layout of the StudioEnvBlock uniform block shared by shaders.
+ *          Every vec3 occupies a vec4 slot, so those members are declared as vec4.
+ *          It is filled once per frame from StudioEnv and uploaded into a uniform buffer.
+ */
+struct StudioEnvBlock
+{
+    glm::vec4   LightPos;
+    glm::vec4   LightAmbient;
+    glm::vec4   LightDiffuse;
+    glm::vec4   LightSpecular;
+    glm::vec4   ViewPos;
+    glm::vec2   ScreenSize;
+    int         NumPointLights;     /// the number of active point lights
+    float       ProjScale;          /// Pixels covered by a unit length at distance 1. The array below starts at a 16 bytes boundary.
+    glm::vec4   PointLightPos[MAX_POINT_LIGHTS];
 };
 
 #endif // STUDIO_ENV_H_INCLUDED
@@ -2,7 +2,7 @@
 #define TEXTRENDERER_H_INCLUDED
 
 #include <string>
-#include <map>
+#include <vector>
 #define GLEW_NO_GLU
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -16,11 +16,66 @@ namespace gl{
 
 using namespace std;
 
+#define NUM_GLYPHS          128     /// Glyphs of ASCII code points are loaded
+#define FONT_PIXEL_SIZE     20      /// Height of text printed at scale 1
+#define FONT_SDF_SIZE       32      /// Height of glyphs in the distance field atlas
+#define FONT_SDF_SPREAD     4       /// Texels of distance stored around each glyph
+#define FONT_SDF_UPSCALE    4       /// Glyphs are rasterized this many times larger to measure distances
+#define FONT_ATLAS_WIDTH    512     /// Width of the glyph atlas. The height fits the glyphs.
+#define FONT_ATLAS_PADDING  1       /// Empty texels between glyphs against filtering bleed
+
+/**
+ * @brief   Layout of a character in pixels of FONT_PIXEL_SIZE
+ *          The quad includes the distance spread around the glyph.
+ */
 struct CharInfo {
-    GLuint      texObj;     /// Texture object for a character
-    glm::ivec2  Size;       /// The size of a character
-    glm::ivec2  Bearing;
-    long int    Advance;
+    glm::vec2   UvMin;      /// Rectangle of a character in the atlas
+    glm::vec2   UvMax;
+    glm::vec2   Size;       /// The size of a character
+    glm::vec2   Bearing;
+    GLfloat     Advance;
+};
+
+/**
+ * @brief   Vertex of a glyph quad. Every glyph carries its color,
+ *          so strings of different colors are drawn together by "TextRenderer::Flush".
+ */
+struct TextVertex {
+    glm::vec4   PosUv;      /// Screen position and atlas coordinates
+    glm::vec3   Color;
+};
+
+/**
+ * @brief   Text kept laid out as glyph quads.
+ *          The quads are built by "TextRenderer::Draw" only when
+ *          the text, position, scale or color has changed since the previous draw.
+ */
+class TextLayout {
+    friend class TextRenderer;
+
+    string      _str;
+    glm::vec2   _pos;
+    GLfloat     _scale;
+    glm::vec3   _fontColor;
+
+    vector<TextVertex>  _vertices;  /// Glyph quads of the current contents
+    bool        _isDirty;           /// Contents changed after the last layout
+
+public :
+    TextLayout();
+
+    TextLayout(const TextLayout&) = delete;
+    TextLayout& operator=(const TextLayout&) = delete;
+
+    /**
+     * @brief   Change contents of the text. Nothing is laid out if they are the same.
+     *
+     * @param str           String to be displayed
+     * @param pos           Starting position of text
+     * @param scale         Scale
+     * @param fontColor     Text Color
+     */
+    void Set(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor);
 };
 
 /**
@@ -28,20 +83,38 @@ struct CharInfo {
  */
 class TextRenderer {
     string      _fontPath;
-    map<GLchar, CharInfo>   _charMap;
+    CharInfo    _chars[NUM_GLYPHS]; /// Indexed by code point
+    GLuint      _atlas;             /// Signed distance fields of all glyphs in one texture
+    vector<GLubyte> _atlasPixels;   /// Atlas texels built by "Load", waiting for the upload
+    GLint       _atlasHeight;
 
-    GLuint      _vbo;               /// vertex buffer object
-    GLuint      _ebo;               /// element array buffer object
+    GLuint      _vbo;               /// vertex buffer object of all layouts drawn in a frame
     GLuint      _vao;               /// vertex array object
+    GLsizeiptr  _vboSize;           /// Allocated bytes of the vertex buffer
+    GLsizei     _vertexCount;       /// Vertices in the vertex buffer
+
+    vector<TextLayout*> _queue;     /// Layouts drawn since the last "Flush"
+    vector<TextLayout*> _uploaded;  /// Layouts in the vertex buffer, in order
+    bool        _isQueueDirty;      /// A layout in the queue was laid out again
 
     Shader*     _pShader;           /// Shader object
 
-    /**
-     * @brief   Generates texture objects for characters
-     *          and store them into internal container with
-     *          related font information for future usage.
-     */
-    bool generateFontTexures();
+    /// Uniform handles resolved once at initialization
+    Uniform     _projLoc;
+    Uniform     _texImgLoc;
+
+    /// Create the atlas texture from texels built by "Load"
+    bool uploadFontAtlas();
+
+    /// Append glyph quads of a string
+    void layoutGlyphs(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor,
+                      vector<TextVertex>& vertices) const;
+
+    /// Vertex attributes of TextVertex for a vertex array object
+    void setupVertexArray(GLuint vao, GLuint vbo);
+
+    /// Shader, projection and atlas for drawing text
+    void beginDraw(StudioEnv& studioEnv);
 public :
     /**
      * @brief   Constructor of Mesh object
@@ -57,21 +130,37 @@ public :
     ~TextRenderer();
 
     /**
-     * @brief   Print 2D text on screen
+     * @brief   Draw a text layout. It is laid out again only if its contents changed.
+     *          The layout is only queued. It is drawn by the next "Flush".
+     *
+     * @param layout        Text layout. It must live until the next "Flush".
+     */
+    void Draw(TextLayout& layout);
+
+    /**
+     * @brief   Draw all layouts queued since the last flush with a single draw call
+     *          The vertex buffer is uploaded only if the queued layouts or their contents changed.
      *
-     * @param str          String to be displayed
-     * @param pos           Starting position of text
-     * @param scale         Scale
-     * @param fontColor     Text Color
      * @param studioEnv     Studio environment
      */
-    void Print(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor, StudioEnv& studioEnv);
+    void Flush(StudioEnv& studioEnv);
+
+    /**
+     * @brief   Packs distance fields of all characters into one atlas
+     *          and store them into internal container with
+     *          related font information for future usage.
+     *          Text of any scale is drawn sharp from this one atlas.
+     *          No GL calls, so it can run on a worker thread before "Initialize".
+     */
+    bool Load();
 
     /**
      * @brief   Initialize all processes before draw an object
      */
     bool Initialize();
 
+    bool IsInitialized() const { return _atlas != 0; }
+
 };
 }
 
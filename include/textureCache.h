@@ -0,0 +1,71 @@
+#ifndef TEXTURE_CACHE_H_INCLUDED
+#define TEXTURE_CACHE_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define GLEW_NO_GLU
+#include <GL/glew.h>
+
+namespace gl
+{
+
+using namespace std;
+
+#define TEXTURE_CACHE_EXT       ".dds"          /// Compressed texture is stored next to the source image
+#define TEXTURE_CACHE_MAGIC     0x58544750      /// "PGTX" in the reserved words of the DDS header
+#define TEXTURE_CACHE_VERSION   1               /// Increase when the encoding of the cache changes
+#define TEXTURE_CACHE_MAX_SIZE  65536           /// Width or height of a cache. Larger than any GL_MAX_TEXTURE_SIZE.
+
+/**
+ * @brief   A mip level in the data of a TextureImage
+ */
+struct TextureLevel
+{
+    int         Width;
+    int         Height;
+    size_t      Offset;     /// Bytes from the beginning of the data
+    size_t      Size;
+};
+
+/**
+ * @brief   Texture image in memory, waiting for upload on the GL thread
+ *          A compressed image has all of its mip levels. An uncompressed one has only the base level,
+ *          and the mip levels are generated by GL.
+ */
+struct TextureImage
+{
+    GLenum                  Format;         /// Internal format
+    bool                    IsCompressed;
+    vector<TextureLevel>    Levels;
+    vector<unsigned char>   Data;
+};
+
+/**
+ * @brief   Load a texture image
+ *          When S3TC is supported, the image is converted once to DXT1 (RGB) or DXT5 (RGBA)
+ *          with a precomputed mip chain and cached as DDS next to the source.
+ *          Later loads read the cache without decoding the source.
+ *          No GL calls, so it can run on a worker thread.
+ *
+ * @param path      Source image file path
+ * @param hasAlpha  Keep the alpha channel
+ * @param image     Loaded image (Return)
+ * @return  result of method
+ */
+bool LoadTextureImage(const string& path, bool hasAlpha, TextureImage& image);
+
+/**
+ * @brief   Create a mipmapped texture object from a loaded image
+ *
+ * @param image     Loaded image
+ * @param wrap      Wrapping mode of both directions
+ * @return  Texture object. 0 if failed.
+ */
+GLuint CreateTextureObject(const TextureImage& image, GLint wrap);
+
+}   /// namespace gl
+
+#endif // TEXTURE_CACHE_H_INCLUDED
@@ -6,6 +6,7 @@
 #include <GLFW/glfw3.h>
 #include "IGraphicObject.h"
 #include "shader.h"
+#include "textureCache.h"
 
 namespace gl
 {
@@ -48,6 +49,21 @@ public:
      */
     virtual bool Initialize();
 
+    /**
+     * @brief   Load the texture image without GL calls, so it can run on a worker thread.
+     *          "Initialize" only uploads an image loaded in advance, or loads it by itself.
+     * @return  result of method
+     */
+    bool LoadTexture();
+
+    /**
+     * @brief   Advance the simulation of an object.
+     *
+     * @param dt        Elapsed time since the previous update in seconds
+     * @param studioEnv Studio environment
+     */
+    virtual void Update(const double dt, StudioEnv& studioEnv) { _time += dt; };
+
     /**
      * @brief   Draw a frame into a back buffer to display at next frame.
      *
@@ -109,6 +125,9 @@ protected:
     bool        SetTextureToShader();
     void        DrawContainer();
 
+    /// Resolve uniform handles from the shader's uniform table
+    virtual void GetUniformLocations();
+
     GLfloat*    _vertices;
     GLuint*     _indices;
     size_t      _sizeVertices;
@@ -129,13 +148,20 @@ protected:
     glm::vec3   _curPos;
 
     const char* _texturePath;       /// Texture file path
+    TextureImage _image;            /// Loaded texture waiting for the upload
 
     Shader*     _pShader;           /// Shader object
 
+    /// Uniform handles resolved once at initialization
+    Uniform     _texImgLoc;
+    Uniform     _PVMLoc;
+
     bool        _isFocused;
 
     ObjectType  _objType;
 
+    double      _time;              /// Simulation time advanced by "Update"
+
 };
 }  /// namespace gl
 
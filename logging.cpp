@@ -1,6 +1,11 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <time.h>
 #include <stdarg.h>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #define GLEW_NO_GLU
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -9,12 +14,198 @@
 #define LOG_FILE "gl.log"
 #define ERR "[GL ERROR]"
 #define LOG "[GL LOG]"
+#define DBG "[GL DEBUG]"
+
+#define LOG_SLOT_SIZE       256     /// Message bytes stored in a slot. Longer messages go to the heap.
+#define LOG_NUM_SLOTS       4096    /// The number of slots in the ring buffer, a power of two
+#define LOG_WRITER_IDLE_MS  2       /// Sleep time of the writer thread when there is nothing to write
 
 namespace gl
 {
 
+namespace
+{
+
+/**
+ * @brief   A slot of the ring buffer
+ *          Sequence tells whether a producer or the writer owns this slot.
+ */
+struct LogSlot
+{
+    std::atomic<size_t> Sequence;
+    LogLevel            Level;
+    char*               LongText;   /// Heap copy of a message not fitting in Text
+    char                Text[LOG_SLOT_SIZE];
+};
+
+/**
+ * @brief   Multi-producer, single consumer bounded queue of log messages
+ *          Producers reserve a slot with one compare and swap and format the message in place.
+ *          Only the writer thread consumes, and it holds the log file open.
+ */
+class LogQueue
+{
+public:
+    LogQueue() : MinLevel(LOG_LEVEL_DEBUG), _enqueuePos(0), _dequeuePos(0),
+                 _dropped(0), _running(false), _file(nullptr)
+    {
+        for(size_t i = 0; i < LOG_NUM_SLOTS; i++)
+        {
+            _slots[i].Sequence.store(i, std::memory_order_relaxed);
+            _slots[i].LongText = nullptr;
+        }
+    }
+
+    ~LogQueue()
+    {
+        Stop();
+    }
+
+    void Start(FILE* file)
+    {
+        _file = file;
+        _running.store(true, std::memory_order_release);
+        _writer = std::thread(&LogQueue::writerLoop, this);
+    }
+
+    void Stop()
+    {
+        if(_writer.joinable())
+        {
+            _running.store(false, std::memory_order_release);
+            _writer.join();
+        }
+
+        /// Writes messages left behind, or discards them if the log was never started
+        flush();
+
+        if(_file)
+        {
+            fclose(_file);
+            _file = nullptr;
+        }
+    }
+
+    void Push(LogLevel level, const char* message, va_list argList)
+    {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        LogSlot* slot;
+
+        for(;;)
+        {
+            slot = &_slots[pos & (LOG_NUM_SLOTS - 1)];
+            size_t seq = slot->Sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+            if(diff == 0)
+            {
+                if(_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0)
+            {
+                /// The writer is behind. Never block the caller.
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+        }
+
+        va_list argCopy;
+        va_copy(argCopy, argList);
+
+        slot->Level = level;
+        slot->LongText = nullptr;
+        int length = vsnprintf(slot->Text, LOG_SLOT_SIZE, message, argList);
+        if(length >= LOG_SLOT_SIZE)
+        {
+            slot->LongText = (char*)malloc(length + 1);
+            if(slot->LongText)
+                vsnprintf(slot->LongText, length + 1, message, argCopy);
+        }
+        va_end(argCopy);
+
+        slot->Sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    std::atomic<int>    MinLevel;
+
+private:
+    LogSlot             _slots[LOG_NUM_SLOTS];
+    std::atomic<size_t> _enqueuePos;
+    size_t              _dequeuePos;    /// Only touched by the consumer
+    std::atomic<size_t> _dropped;
+    std::atomic<bool>   _running;
+    std::thread         _writer;
+    FILE*               _file;
+
+    /// Writes one message into the file and returns the slot to producers
+    bool pop()
+    {
+        LogSlot* slot = &_slots[_dequeuePos & (LOG_NUM_SLOTS - 1)];
+        size_t seq = slot->Sequence.load(std::memory_order_acquire);
+        if(seq != _dequeuePos + 1)
+            return false;
+
+        if(_file)
+        {
+            const char* prefix = (slot->Level == LOG_LEVEL_ERROR) ? ERR :
+                                 (slot->Level == LOG_LEVEL_DEBUG) ? DBG : LOG;
+            fputs(prefix, _file);
+            fputs(slot->LongText ? slot->LongText : slot->Text, _file);
+        }
+
+        if(slot->LongText)
+        {
+            free(slot->LongText);
+            slot->LongText = nullptr;
+        }
+
+        slot->Sequence.store(_dequeuePos + LOG_NUM_SLOTS, std::memory_order_release);
+        _dequeuePos++;
+        return true;
+    }
+
+    /// Writes all messages in the queue. Returns true if anything was written.
+    bool flush()
+    {
+        bool written = false;
+        while(pop())
+            written = true;
+
+        size_t dropped = _dropped.exchange(0, std::memory_order_relaxed);
+        if(dropped && _file)
+        {
+            fprintf(_file, "%s %zu log messages were dropped \n", ERR, dropped);
+            written = true;
+        }
+
+        if(written && _file)
+            fflush(_file);
+
+        return written;
+    }
+
+    void writerLoop()
+    {
+        while(_running.load(std::memory_order_acquire))
+        {
+            if(!flush())
+                std::this_thread::sleep_for(std::chrono::milliseconds(LOG_WRITER_IDLE_MS));
+        }
+    }
+};
+
+LogQueue s_logQueue;
+
+} /// namespace
+
 void RestartLog()
 {
+    /// Closes the previous log file if it is open
+    s_logQueue.Stop();
+
     FILE* file = fopen(LOG_FILE, "w");
     if (!file) {
         fprintf(stderr, "%s Could not open GL_LOG_FILE (%s) for writing \n", ERR, LOG_FILE);
@@ -25,46 +216,52 @@ void RestartLog()
     char* date = ctime(&now);
 
     fprintf(file, "\n%s local time %s \n",LOG, date);
-    fclose(file);
+    s_logQueue.Start(file);
 }
 
-void Log(const char* message, ...)
+void StopLog()
 {
-    va_list argList;
-    FILE* file = fopen(LOG_FILE, "a");
-    if (!file) {
-        fprintf(file, "%s Could not open GL_LOG_FILE (%s) for appending \n", ERR, LOG_FILE);
+    s_logQueue.Stop();
+}
+
+void SetLogLevel(LogLevel level)
+{
+    s_logQueue.MinLevel.store(level, std::memory_order_relaxed);
+}
+
+void LogMessage(LogLevel level, const char* message, ...)
+{
+    if(level < s_logQueue.MinLevel.load(std::memory_order_relaxed))
         return;
-    }
 
+    va_list argList;
     va_start(argList, message);
-    fprintf(file, "%s", LOG);
-    vfprintf(file, message, argList);
+    s_logQueue.Push(level, message, argList);
     va_end(argList);
+}
+
+void Log(const char* message, ...)
+{
+    if(LOG_LEVEL_INFO < s_logQueue.MinLevel.load(std::memory_order_relaxed))
+        return;
 
-    fclose(file);
+    va_list argList;
+    va_start(argList, message);
+    s_logQueue.Push(LOG_LEVEL_INFO, message, argList);
+    va_end(argList);
 }
 
 void LogError(const char* message, ...)
 {
     va_list argList;
-    FILE* file = fopen(LOG_FILE, "a");
-    if (!file) {
-        fprintf(file, "%s Could not open GL_LOG_FILE (%s) for appending \n", ERR, LOG_FILE);
-        return;
-    }
-
     va_start(argList, message);
-    fprintf(file, "%s", LOG);
-    vfprintf(file, message, argList);
+    s_logQueue.Push(LOG_LEVEL_ERROR, message, argList);
     va_end(argList);
 
     va_start(argList, message);
-    fprintf(stderr, "%s", LOG);
+    fprintf(stderr, "%s", ERR);
     vfprintf(stderr, message, argList);
     va_end(argList);
-
-    fclose(file);
 }
 
 void LogGlVersionInfo()
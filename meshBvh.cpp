@@ -0,0 +1,368 @@
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include "meshBvh.h"
+#include "rayIntersect.h"
+
+#define MESH_BVH_BINS           16      /// SAH bins per axis
+#define MESH_BVH_MAX_LEAF       8       /// A node with more triangles is always split
+#define MESH_BVH_TRAVERSAL_COST 1.0f    /// Cost of a node visit relative to a triangle test
+#define MESH_BVH_PARALLEL_SIZE  4096    /// Subtrees smaller than this are built by one thread
+#define MESH_BVH_PARALLEL_DEPTH 3       /// Up to 2^depth threads
+#define MESH_BVH_MAX_DEPTH      64      /// Size of the traversal stack. The tree is not deeper than this.
+
+namespace gl
+{
+
+namespace
+{
+
+/// A triangle while building
+struct BuildRef
+{
+    glm::vec3   Min;
+    glm::vec3   Max;
+    glm::vec3   Center;
+    uint32_t    Triangle;
+};
+
+struct Bin
+{
+    glm::vec3   Min;
+    glm::vec3   Max;
+    uint32_t    Count;
+};
+
+float HalfArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 d = boxMax - boxMin;
+    return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+/**
+ * @brief   Builds subtrees over disjoint ranges of the reference array
+ *          Each subtree is stored in its own node array with local indices,
+ *          so subtrees built by different threads are merged by offsetting them.
+ */
+class MeshBvhBuilder
+{
+public:
+    explicit MeshBvhBuilder(vector<BuildRef>& refs) : _refs(refs) {}
+
+    void Build(uint32_t first, uint32_t count, uint32_t depth, vector<MeshBvhNode>& nodes)
+    {
+        uint32_t nodeIndex = nodes.size();
+        nodes.push_back(MeshBvhNode());
+
+        glm::vec3 boxMin(FLT_MAX), boxMax(-FLT_MAX);
+        glm::vec3 centerMin(FLT_MAX), centerMax(-FLT_MAX);
+        for(uint32_t i = first; i < first + count; i++)
+        {
+            boxMin = glm::min(boxMin, _refs[i].Min);
+            boxMax = glm::max(boxMax, _refs[i].Max);
+            centerMin = glm::min(centerMin, _refs[i].Center);
+            centerMax = glm::max(centerMax, _refs[i].Center);
+        }
+        nodes[nodeIndex].Min = boxMin;
+        nodes[nodeIndex].Max = boxMax;
+
+        uint32_t mid = (depth + 1 < MESH_BVH_MAX_DEPTH) ? split(first, count, boxMin, boxMax, centerMin, centerMax) : 0;
+        if(mid == 0)
+        {
+            nodes[nodeIndex].First = first;
+            nodes[nodeIndex].Count = count;
+            return;
+        }
+
+        uint32_t leftCount = mid - first;
+        uint32_t rightCount = count - leftCount;
+
+        if(depth < MESH_BVH_PARALLEL_DEPTH && count >= MESH_BVH_PARALLEL_SIZE)
+        {
+            /// Two halves are independent. The left one is built by another thread.
+            vector<MeshBvhNode> leftNodes, rightNodes;
+            std::thread worker(&MeshBvhBuilder::Build, this, first, leftCount, depth + 1, std::ref(leftNodes));
+            Build(mid, rightCount, depth + 1, rightNodes);
+            worker.join();
+
+            append(nodes, leftNodes);
+            uint32_t right = append(nodes, rightNodes);
+            nodes[nodeIndex].First = right;
+        }
+        else
+        {
+            Build(first, leftCount, depth + 1, nodes);
+            nodes[nodeIndex].First = nodes.size();
+            Build(mid, rightCount, depth + 1, nodes);
+        }
+        nodes[nodeIndex].Count = 0;
+    }
+
+private:
+    vector<BuildRef>&   _refs;
+
+    /// Appends a subtree and returns the index of its root
+    uint32_t append(vector<MeshBvhNode>& nodes, const vector<MeshBvhNode>& subtree)
+    {
+        uint32_t offset = nodes.size();
+        for(uint32_t i = 0; i < subtree.size(); i++)
+        {
+            MeshBvhNode node = subtree[i];
+            if(node.Count == 0)
+                node.First += offset;
+            nodes.push_back(node);
+        }
+        return offset;
+    }
+
+    /**
+     * @brief   Partition the range by the best SAH split
+     * @return  the first reference of the right half, or 0 to make a leaf
+     */
+    uint32_t split(uint32_t first, uint32_t count, const glm::vec3& boxMin, const glm::vec3& boxMax,
+                   const glm::vec3& centerMin, const glm::vec3& centerMax)
+    {
+        if(count <= 2)
+            return 0;
+
+        glm::vec3 extent = centerMax - centerMin;
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestBin = 0;
+
+        for(int axis = 0; axis < 3; axis++)
+        {
+            if(extent[axis] <= 0.f)
+                continue;
+
+            Bin bins[MESH_BVH_BINS];
+            for(int b = 0; b < MESH_BVH_BINS; b++)
+            {
+                bins[b].Min = glm::vec3(FLT_MAX);
+                bins[b].Max = glm::vec3(-FLT_MAX);
+                bins[b].Count = 0;
+            }
+
+            float scale = MESH_BVH_BINS / extent[axis];
+            for(uint32_t i = first; i < first + count; i++)
+            {
+                int b = std::min((int)((_refs[i].Center[axis] - centerMin[axis]) * scale), MESH_BVH_BINS - 1);
+                bins[b].Min = glm::min(bins[b].Min, _refs[i].Min);
+                bins[b].Max = glm::max(bins[b].Max, _refs[i].Max);
+                bins[b].Count++;
+            }
+
+            /// Sweep from the right to get areas of all right halves
+            float rightArea[MESH_BVH_BINS];
+            uint32_t rightCount[MESH_BVH_BINS];
+            glm::vec3 accMin(FLT_MAX), accMax(-FLT_MAX);
+            uint32_t accCount = 0;
+            for(int b = MESH_BVH_BINS - 1; b > 0; b--)
+            {
+                accMin = glm::min(accMin, bins[b].Min);
+                accMax = glm::max(accMax, bins[b].Max);
+                accCount += bins[b].Count;
+                rightArea[b] = accCount ? HalfArea(accMin, accMax) : 0.f;
+                rightCount[b] = accCount;
+            }
+
+            accMin = glm::vec3(FLT_MAX);
+            accMax = glm::vec3(-FLT_MAX);
+            accCount = 0;
+            for(int b = 1; b < MESH_BVH_BINS; b++)
+            {
+                accMin = glm::min(accMin, bins[b - 1].Min);
+                accMax = glm::max(accMax, bins[b - 1].Max);
+                accCount += bins[b - 1].Count;
+                if(accCount == 0 || rightCount[b] == 0)
+                    continue;
+
+                float cost = HalfArea(accMin, accMax) * accCount + rightArea[b] * rightCount[b];
+                if(cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = b;
+                }
+            }
+        }
+
+        float leafCost = (float)count;
+        float splitCost = MESH_BVH_TRAVERSAL_COST + bestCost / HalfArea(boxMin, boxMax);
+
+        uint32_t mid;
+        if(bestAxis < 0)
+        {
+            /// All centers at one point. Only a median split separates them.
+            if(count <= MESH_BVH_MAX_LEAF)
+                return 0;
+            mid = first + count / 2;
+        }
+        else
+        {
+            if(splitCost >= leafCost && count <= MESH_BVH_MAX_LEAF)
+                return 0;
+
+            float scale = MESH_BVH_BINS / extent[bestAxis];
+            float minCenter = centerMin[bestAxis];
+            BuildRef* middle = std::partition(&_refs[first], &_refs[first] + count,
+                [=](const BuildRef& ref) {
+                    return std::min((int)((ref.Center[bestAxis] - minCenter) * scale), MESH_BVH_BINS - 1) < bestBin;
+                });
+            mid = middle - &_refs[0];
+        }
+
+        return mid;
+    }
+};
+
+}   /// namespace
+
+bool MeshBvh::Build(const float* positions, size_t stride, const uint32_t* indices, size_t numIndices)
+{
+    Nodes.clear();
+    Triangles.clear();
+
+    uint32_t numTriangles = numIndices / 3;
+    if(numTriangles == 0)
+        return false;
+
+    const char* base = (const char*)positions;
+    vector<MeshBvhTriangle> triangles(numTriangles);
+    vector<BuildRef> refs(numTriangles);
+
+    for(uint32_t i = 0; i < numTriangles; i++)
+    {
+        const float* p0 = (const float*)(base + indices[i * 3] * stride);
+        const float* p1 = (const float*)(base + indices[i * 3 + 1] * stride);
+        const float* p2 = (const float*)(base + indices[i * 3 + 2] * stride);
+        glm::vec3 v0(p0[0], p0[1], p0[2]), v1(p1[0], p1[1], p1[2]), v2(p2[0], p2[1], p2[2]);
+
+        triangles[i].V0 = v0;
+        triangles[i].E1 = v1 - v0;
+        triangles[i].E2 = v2 - v0;
+
+        refs[i].Min = glm::min(v0, glm::min(v1, v2));
+        refs[i].Max = glm::max(v0, glm::max(v1, v2));
+        refs[i].Center = (refs[i].Min + refs[i].Max) * 0.5f;
+        refs[i].Triangle = i;
+    }
+
+    MeshBvhBuilder builder(refs);
+    Nodes.reserve(2 * numTriangles);
+    builder.Build(0, numTriangles, 0, Nodes);
+
+    /// Store triangles in the leaf order
+    Triangles.resize(numTriangles);
+    for(uint32_t i = 0; i < numTriangles; i++)
+        Triangles[i] = triangles[refs[i].Triangle];
+
+    return true;
+}
+
+bool MeshBvh::Intersect(const glm::vec3& org, const glm::vec3& dir, float& distance) const
+{
+    if(Nodes.empty())
+        return false;
+
+    glm::vec3 invDir = 1.f / dir;
+    float closest = FLT_MAX;
+    bool isHit = false;
+
+    uint32_t stack[MESH_BVH_MAX_DEPTH];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        uint32_t nodeIndex = stack[--stackSize];
+        const MeshBvhNode& node = Nodes[nodeIndex];
+
+        float entry;
+        if(!IntersectRayAabb(org, invDir, node.Min, node.Max, closest, entry))
+            continue;
+
+        if(node.Count > 0)
+        {
+            /// Moller-Trumbore ray triangle test
+            for(uint32_t i = node.First; i < node.First + node.Count; i++)
+            {
+                const MeshBvhTriangle& tri = Triangles[i];
+                glm::vec3 p = glm::cross(dir, tri.E2);
+                float det = glm::dot(tri.E1, p);
+                if(fabsf(det) < 1e-12f)
+                    continue;
+
+                float invDet = 1.f / det;
+                glm::vec3 s = org - tri.V0;
+                float u = glm::dot(s, p) * invDet;
+                if(u < 0.f || u > 1.f)
+                    continue;
+
+                glm::vec3 q = glm::cross(s, tri.E1);
+                float v = glm::dot(dir, q) * invDet;
+                if(v < 0.f || u + v > 1.f)
+                    continue;
+
+                float t = glm::dot(tri.E2, q) * invDet;
+                if(t >= 0.f && t < closest)
+                {
+                    closest = t;
+                    isHit = true;
+                }
+            }
+            continue;
+        }
+
+        /// Visit the nearer child first, so farther subtrees are pruned by the closest hit
+        uint32_t left = nodeIndex + 1;
+        uint32_t right = node.First;
+        float leftEntry, rightEntry;
+        bool isLeftHit = IntersectRayAabb(org, invDir, Nodes[left].Min, Nodes[left].Max, closest, leftEntry);
+        bool isRightHit = IntersectRayAabb(org, invDir, Nodes[right].Min, Nodes[right].Max, closest, rightEntry);
+
+        if(isLeftHit && isRightHit)
+        {
+            if(leftEntry < rightEntry)
+                std::swap(left, right);
+            stack[stackSize++] = left;
+            stack[stackSize++] = right;
+        }
+        else if(isLeftHit)
+            stack[stackSize++] = left;
+        else if(isRightHit)
+            stack[stackSize++] = right;
+    }
+
+    if(isHit)
+        distance = closest;
+
+    return isHit;
+}
+
+bool MeshBvh::IsValid() const
+{
+    /// Children follow their parent, so depths are known in one pass
+    vector<uint32_t> depths(Nodes.size(), 0);
+    for(uint32_t i = 0; i < Nodes.size(); i++)
+    {
+        const MeshBvhNode& node = Nodes[i];
+        if(node.Count > 0)
+        {
+            if((uint64_t)node.First + node.Count > Triangles.size())
+                return false;
+            continue;
+        }
+
+        /// The left child is the next node and the right child is after the left subtree
+        if(node.First <= i + 1 || node.First >= Nodes.size() || depths[i] + 1 >= MESH_BVH_MAX_DEPTH)
+            return false;
+
+        depths[i + 1] = std::max(depths[i + 1], depths[i] + 1);
+        depths[node.First] = std::max(depths[node.First], depths[i] + 1);
+    }
+    return true;
+}
+
+}   /// namespace gl
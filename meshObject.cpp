@@ -1,17 +1,28 @@
 #include <stddef.h>
+#include <math.h>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <glm/gtc/packing.hpp>
 #include "meshObject.h"
+#include "rayIntersect.h"
+#include "logging.h"
 
 namespace gl
 {
 
-MeshObject::MeshObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures)
+MeshObject::MeshObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures) :
+    _vertices(std::move(vertices)), _indices(std::move(indices)), _textures(std::move(textures))
 {
-    _vertices = vertices;
-    _indices = indices;
-    _textures = textures;
+    _indexCount = _indices.size();
+    _indexType = GL_UNSIGNED_INT;
+    _curLod = 0;
+    _releaseMeshData = false;
+    _isPackedVertex = false;
+    _posOffset = glm::vec3(0.f);
+    _posScale = glm::vec3(1.f);
+    _boundCenter = glm::vec3(0.f);
+    _boundRadius = 0.f;
 
     _T = glm::mat4(1);
     _S = glm::mat4(1);
@@ -21,6 +32,10 @@ MeshObject::MeshObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint>
     _objectColor = glm::vec3(0);
     _focusColor = glm::vec3(0);
     _isFocused = false;
+    _focusedTime = 0.;
+    _time = 0.;
+    _curPos = _prevPos = glm::vec3(0.f);
+    _angle = _prevAngle = 0.f;
 }
 
 MeshObject::~MeshObject()
@@ -32,6 +47,12 @@ MeshObject::~MeshObject()
 
 bool MeshObject::Initialize()
 {
+    if(_vertices.empty() || _indices.empty())
+    {
+        LogError("[MeshObject][Initialize] mesh has no triangles \n");
+        return false;
+    }
+
     glGenVertexArrays(1, &_vao);
     glGenBuffers(1, &_vbo);
     glGenBuffers(1, &_ebo);
@@ -39,10 +60,80 @@ bool MeshObject::Initialize()
     glBindVertexArray(_vao);
 
     glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), &_vertices[0], GL_STATIC_DRAW);
+    if(_isPackedVertex)
+    {
+        vector<PackedVertex> packed;
+        packVertices(packed);
+        glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+    }
+    else
+        glBufferData(GL_ARRAY_BUFFER, _vertices.size() * sizeof(Vertex), _vertices.data(), GL_STATIC_DRAW);
 
+    /// 16-bit indices halve the index bandwidth when they can address every vertex
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _ebo);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(GLuint), &_indices[0], GL_STATIC_DRAW);
+    if(_vertices.size() < 65536)
+    {
+        vector<GLushort> shortIndices(_indices.begin(), _indices.end());
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+        _indexType = GL_UNSIGNED_SHORT;
+    }
+    else
+    {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, _indices.size() * sizeof(GLuint), _indices.data(), GL_STATIC_DRAW);
+        _indexType = GL_UNSIGNED_INT;
+    }
+
+    /// A range outside the index buffer would make the draw read past it
+    for(GLuint i = 0; i < _lods.size(); i++)
+    {
+        if((uint64_t)_lods[i].FirstIndex + _lods[i].IndexCount > _indices.size())
+        {
+            LogError("[MeshObject][Initialize] LOD %d is out of the index buffer. Levels are dropped. \n", i);
+            _lods.clear();
+            break;
+        }
+    }
+
+    if(_lods.empty())
+    {
+        MeshLod lod = { 0, (GLuint)_indices.size(), 0.f };
+        _lods.push_back(lod);
+    }
+    _indexCount = _lods[0].IndexCount;
+
+    setupVertexAttributes();
+
+    glBindVertexArray(0);
+
+    calcBoundingSphere();
+
+    /// GPU owns the mesh from now on
+    if(_releaseMeshData)
+    {
+        vector<Vertex>().swap(_vertices);
+        vector<GLuint>().swap(_indices);
+    }
+
+    GetUniformLocations();
+
+    return true;
+}
+
+void MeshObject::setupVertexAttributes()
+{
+    if(_isPackedVertex)
+    {
+        /// Normalized integers are read as floats in [-1, 1], so shaders take vec3 and vec2 for both formats
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+        return;
+    }
 
     /// Position attribute
     glEnableVertexAttribArray(0);
@@ -55,10 +146,152 @@ bool MeshObject::Initialize()
     /// TexCoords attribute
     glEnableVertexAttribArray(2);
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+}
 
-    glBindVertexArray(0);
+/// Signed normalized 10 bit component of GL_INT_2_10_10_10_REV
+static GLuint PackSnorm10(float value)
+{
+    return (GLuint)(GLint)roundf(glm::clamp(value, -1.f, 1.f) * 511.f) & 0x3FF;
+}
 
-    return true;
+void MeshObject::packVertices(vector<PackedVertex>& packed)
+{
+    glm::vec3 minPos = _vertices[0].Position;
+    glm::vec3 maxPos = _vertices[0].Position;
+    for(GLuint i = 1; i < _vertices.size(); i++)
+    {
+        minPos = glm::min(minPos, _vertices[i].Position);
+        maxPos = glm::max(maxPos, _vertices[i].Position);
+    }
+
+    /// Positions are stored in [-1, 1] over the bounding box
+    _posOffset = (minPos + maxPos) * 0.5f;
+    _posScale = glm::max((maxPos - minPos) * 0.5f, glm::vec3(1e-6f));
+
+    packed.resize(_vertices.size());
+    for(GLuint i = 0; i < _vertices.size(); i++)
+    {
+        const Vertex& vertex = _vertices[i];
+        PackedVertex& out = packed[i];
+
+        glm::vec3 pos = glm::clamp((vertex.Position - _posOffset) / _posScale, -1.f, 1.f);
+        out.Position[0] = (GLshort)roundf(pos.x * 32767.f);
+        out.Position[1] = (GLshort)roundf(pos.y * 32767.f);
+        out.Position[2] = (GLshort)roundf(pos.z * 32767.f);
+        out.Position[3] = 0;
+
+        out.Normal = PackSnorm10(vertex.Normal.x) | (PackSnorm10(vertex.Normal.y) << 10) | (PackSnorm10(vertex.Normal.z) << 20);
+
+        out.TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+        out.TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+    }
+}
+
+void MeshObject::GetUniformLocations()
+{
+    GLuint diffuseCnt = 1;
+    GLuint specularCnt = 1;
+
+    /// Sampler names are numbered per texture type, such as textureDiffuse1 and textureSpecular1
+    _textureLocs.resize(_textures.size());
+    for(GLuint i = 0; i < _textures.size(); i++)
+    {
+        bool isDiffuse = (_textures[i].type == Texture_Diffuse);
+        GLuint cnt = isDiffuse ? diffuseCnt++ : specularCnt++;
+        const char* name = isDiffuse ? "textureDiffuse" : "textureSpecular";
+
+        _textureLocs[i] = _pShader->GetUniform(name + to_string(cnt));
+    }
+
+    _shininessLoc = _pShader->GetUniform("textureShininess");
+
+    /// lighting of this object
+    _lightDiffuseLoc = _pShader->GetUniform("lightDiffuse");
+    _lightSpecularLoc = _pShader->GetUniform("lightSpecular");
+
+    /// matrix
+    _PVLoc = _pShader->GetUniform("PV");
+    _MLoc = _pShader->GetUniform("M");
+    _normalMatLoc = _pShader->GetUniform("normalMat");
+    _posOffsetLoc = _pShader->GetUniform("posOffset");
+    _posScaleLoc = _pShader->GetUniform("posScale");
+}
+
+void MeshObject::calcBoundingSphere()
+{
+    if(_vertices.empty())
+        return;
+
+    /// Center of the bounding box and the farthest vertex from it
+    glm::vec3 minPos = _vertices[0].Position;
+    glm::vec3 maxPos = _vertices[0].Position;
+    for(GLuint i = 1; i < _vertices.size(); i++)
+    {
+        minPos = glm::min(minPos, _vertices[i].Position);
+        maxPos = glm::max(maxPos, _vertices[i].Position);
+    }
+
+    _boundCenter = (minPos + maxPos) * 0.5f;
+
+    GLfloat maxDist2 = 0.f;
+    for(GLuint i = 0; i < _vertices.size(); i++)
+    {
+        glm::vec3 d = _vertices[i].Position - _boundCenter;
+        maxDist2 = glm::max(maxDist2, glm::dot(d, d));
+    }
+    _boundRadius = sqrtf(maxDist2);
+}
+
+void MeshObject::transformBoundingSphere(const glm::mat4& mat, glm::vec3& center, GLfloat& radius)
+{
+    center = glm::vec3(mat * glm::vec4(_boundCenter, 1.f));
+
+    /// The largest axis scale keeps the sphere conservative
+    GLfloat scale2 = glm::max(glm::dot(glm::vec3(mat[0]), glm::vec3(mat[0])),
+                     glm::max(glm::dot(glm::vec3(mat[1]), glm::vec3(mat[1])),
+                              glm::dot(glm::vec3(mat[2]), glm::vec3(mat[2]))));
+    radius = _boundRadius * sqrtf(scale2);
+}
+
+GLuint MeshObject::selectLod(const glm::vec3& center, GLfloat radius, const StudioEnv& studioEnv)
+{
+    if(_boundRadius <= 0.f)
+        return 0;
+
+    /// Errors are in model space. The nearest point of the sphere sees them largest.
+    GLfloat scale = radius / _boundRadius;
+    GLfloat distance = glm::length(center - studioEnv.ViewPos) - radius;
+    if(distance <= 0.f)
+        return 0;
+
+    /// Levels are ordered by increasing error
+    GLuint lod = 0;
+    for(GLuint i = 1; i < _lods.size(); i++)
+    {
+        if(_lods[i].Error * scale * studioEnv.ProjScale > MESH_LOD_PIXEL_ERROR * distance)
+            break;
+        lod = i;
+    }
+
+    return lod;
+}
+
+GLvoid* MeshObject::getLodOffset(GLuint lod)
+{
+    size_t indexSize = (_indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    return (GLvoid*)(_lods[lod].FirstIndex * indexSize);
+}
+
+bool MeshObject::CullByFrustum(const Frustum& frustum)
+{
+    glm::vec3 center;
+    GLfloat radius;
+    transformBoundingSphere(_modelMat, center, radius);
+
+    /// Rendering interpolates from the previous step, so the sphere covers the move
+    radius += glm::length(_curPos - _prevPos);
+
+    return frustum.IsSphereVisible(center, radius);
 }
 
 bool MeshObject::Transform(glm::vec3 s, glm::vec3 t)
@@ -85,26 +318,14 @@ bool MeshObject::SetTextureToShader()
     /// Activate shader
     _pShader->Use();
 
-    GLuint diffuseCnt = 1;
-    GLuint specularCnt = 1;
-
-    char uniformName[100];
-
     for(GLuint i = 0; i < _textures.size(); i++)
     {
         glActiveTexture(GL_TEXTURE0 + i);
-
-        GLuint cnt = (_textures[i].type == Texture_Diffuse) ? diffuseCnt++ : specularCnt++;
-        const char* name = (_textures[i].type == Texture_Diffuse) ? "textureDiffuse" : "textureSpecular";
-
-        sprintf(uniformName, "%s%d", name, cnt);
-
-        glUniform1i(glGetUniformLocation(_pShader->GetProgram(), uniformName), i);
-
+        _textureLocs[i].Set((GLint)i);
         glBindTexture(GL_TEXTURE_2D, _textures[i].object);
     }
 
-    glUniform1f(glGetUniformLocation(_pShader->GetProgram(), "textureShininess"), 32.0f);
+    _shininessLoc.Set(32.0f);
 
     return true;
 }
@@ -121,48 +342,18 @@ void MeshObject::GetCurObjectInfo(struct ObjectInfo& objInfo)
     objInfo.ObjRadius = _S[0][0];
 }
 
-bool MeshObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+void MeshObject::Update(const double dt, StudioEnv& studioEnv)
 {
-    if(SetTextureToShader() == false)
-        return false;
+    _time += dt;
 
-    const GLuint program = _pShader->GetProgram();
+    const double time = _time;
 
-    /// lighting
-    glUniform3fv(glGetUniformLocation(program, "lightPos"), 1, &studioEnv.LightPos.x);
-    glUniform3fv(glGetUniformLocation(program, "lightAmbient"), 1, &studioEnv.LightAmbient.x);
+    if(_isFocused && time - _focusedTime > FOCUSEDTIME)
+        _isFocused = false;
 
-    if(_isFocused) {
-        glUniform3fv(glGetUniformLocation(program, "lightDiffuse"), 1, &_focusColor.x);
-        glUniform3fv(glGetUniformLocation(program, "lightSpecular"), 1, &_focusColor.x);
-        if(time - _focusedTime > FOCUSEDTIME)
-            _isFocused = false;
-    }
-    else {
-        glUniform3fv(glGetUniformLocation(program, "lightDiffuse"), 1, &studioEnv.LightDiffuse.x);
-        glUniform3fv(glGetUniformLocation(program, "lightSpecular"), 1, &studioEnv.LightSpecular.x);
-    }
-
-    /// Point light
-    for(int i = 0; i < NUM_POINT_LIGHTS; i++)
-    {
-        string str("pointLights[");
-        str += (char)('0' + i);
-        str += "].position";
-        glUniform3fv(glGetUniformLocation(program, str.c_str()), 1, &studioEnv.PointLightPos[i].x);
-    }
-
-    /// viewer
-    glUniform3fv(glGetUniformLocation(program, "viewPos"), 1, &studioEnv.ViewPos.x);
-
-    /// matrix
-    GLfloat rcos = cos(glm::radians(time * 50.));
-    GLfloat rsin = sin(glm::radians(time * 50.));
-
-    glm::mat4 R(rcos, 0.0f, -rsin, 0.0f,
-                0.0f, 1.0f,  0.0f, 0.0f,
-                rsin, 0.0f,  rcos, 0.0f,
-                0.0f, 0.0f,  0.0f, 1.0f);
+    _prevPos = _curPos;
+    _prevAngle = _angle;
+    _angle = time * 50.;
 
     /// The movement will be faster whenever the game stage increases.
     float speed = time * 30. * studioEnv.GameStage;
@@ -183,12 +374,56 @@ bool MeshObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studi
     }
     _curPos.z = _T[3][2];
 
-    _modelMat = _T* R *_S;
-    glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(_modelMat)));
+    _modelMat = getModelMatrix(_curPos, _angle);
+    _normalMat = glm::transpose(glm::inverse(glm::mat3(_modelMat)));
+}
+
+glm::mat4 MeshObject::getModelMatrix(glm::vec3 pos, GLfloat angle)
+{
+    GLfloat rcos = cos(glm::radians(angle));
+    GLfloat rsin = sin(glm::radians(angle));
+
+    glm::mat4 R(rcos, 0.0f, -rsin, 0.0f,
+                0.0f, 1.0f,  0.0f, 0.0f,
+                rsin, 0.0f,  rcos, 0.0f,
+                0.0f, 0.0f,  0.0f, 1.0f);
+
+    glm::mat4 T = _T;
+    T[3][0] = pos.x; T[3][1] = pos.y; T[3][2] = pos.z;
+
+    return T * R * _S;
+}
+
+bool MeshObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+{
+    if(SetTextureToShader() == false)
+        return false;
+
+    /// lighting
+    if(_isFocused) {
+        _lightDiffuseLoc.Set(_focusColor);
+        _lightSpecularLoc.Set(_focusColor);
+    }
+    else {
+        _lightDiffuseLoc.Set(studioEnv.LightDiffuse);
+        _lightSpecularLoc.Set(studioEnv.LightSpecular);
+    }
+
+    /// Interpolate between the previous and the current simulation step
+    const float alpha = studioEnv.RenderAlpha;
+    glm::mat4 modelMat = getModelMatrix(glm::mix(_prevPos, _curPos, alpha), glm::mix(_prevAngle, _angle, alpha));
+    glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(modelMat)));
+
+    _PVLoc.Set(PV);
+    _MLoc.Set(modelMat);
+    _normalMatLoc.Set(normalMat);
+    _posOffsetLoc.Set(_posOffset);
+    _posScaleLoc.Set(_posScale);
 
-    glUniformMatrix4fv(glGetUniformLocation(program, "PV"), 1, GL_FALSE,  &PV[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(program, "M"), 1, GL_FALSE,  &_modelMat[0][0]);
-    glUniformMatrix3fv(glGetUniformLocation(program, "normalMat"), 1, GL_FALSE,  &normalMat[0][0]);
+    glm::vec3 center;
+    GLfloat radius;
+    transformBoundingSphere(modelMat, center, radius);
+    _curLod = selectLod(center, radius, studioEnv);
 
     DrawContainer();
 
@@ -199,7 +434,7 @@ void MeshObject::DrawContainer()
 {
     /// Draw mesh
     glBindVertexArray(_vao);
-    glDrawElements(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, 0);
+    glDrawElements(GL_TRIANGLES, _lods[_curLod].IndexCount, _indexType, getLodOffset(_curLod));
     glBindVertexArray(0);
 
     for (GLuint i = 0; i < _textures.size(); i++)
@@ -213,30 +448,34 @@ void MeshObject::Focus(bool isFocused, glm::vec3 focusColor)
 {
     _isFocused = isFocused;
     _focusColor = focusColor;
-    _focusedTime = glfwGetTime();
+    _focusedTime = _time;
 }
 
-bool MeshObject::IsIntersected(glm::vec3 org, glm::vec3 dir, float *distance)
+bool MeshObject::GetInstanceBound(uint32_t index, glm::vec3& center, float& radius)
 {
-    glm::vec3 center(_modelMat[3][0], _modelMat[3][1], _modelMat[3][2]);
-    float radius = _S[0][0] * 2.f;
-
-	/// work out components of quadratic
-	glm::vec3 objDir = center - org;
-	float objDist = glm::length(objDir);
-
-	/// calculate estimated casted position with this object
-    glm::vec3 castedPos = org + objDist * dir;
+    transformBoundingSphere(_modelMat, center, radius);
+    return true;
+}
 
-    float dist = glm::length(center - castedPos);
+bool MeshObject::IsIntersected(glm::vec3 org, glm::vec3 dir, float *distance)
+{
+    glm::vec3 center;
+    float radius;
+    transformBoundingSphere(_modelMat, center, radius);
 
-	*distance = objDist;
+    /// Most rays miss the bounding sphere
+    if(!IntersectRaySphere(org, dir, center, radius, *distance))
+        return false;
 
-	printf("[%s] distance %f radius %f \n", __FUNCTION__, *distance, radius);
-	if(dist <= radius)
+    if(_bvh.IsEmpty())
         return true;
 
-    return false;
+    /// The ray in model space keeps the distance in world units, as the direction is not normalized
+    glm::mat4 invModel = glm::inverse(_modelMat);
+    glm::vec3 modelOrg = glm::vec3(invModel * glm::vec4(org, 1.f));
+    glm::vec3 modelDir = glm::vec3(invModel * glm::vec4(dir, 0.f));
+
+    return _bvh.Intersect(modelOrg, modelDir, *distance);
 }
 
 }
@@ -0,0 +1,630 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "meshOptimizer.h"
+#include "logging.h"
+
+#define FORSYTH_CACHE_DECAY_POWER   1.5f
+#define FORSYTH_LAST_TRI_SCORE      0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+#define SIMPLIFY_MAX_PASSES         64      /// Each pass collapses edges whose neighbourhoods do not overlap
+#define LOD_MIN_REDUCTION           0.8f    /// A level keeping more indices than this of the previous one is dropped
+
+namespace gl
+{
+
+namespace
+{
+
+/// FNV-1a over all attributes of a vertex
+uint32_t HashVertex(const Vertex& vertex)
+{
+    const unsigned char* bytes = (const unsigned char*)&vertex;
+    uint32_t hash = 2166136261u;
+    for(uint32_t i = 0; i < sizeof(Vertex); i++)
+        hash = (hash ^ bytes[i]) * 16777619u;
+    return hash;
+}
+
+struct ForsythVertex
+{
+    float       Score;
+    uint32_t    FirstTri;       /// Triangles of this vertex in the adjacency list
+    uint32_t    NumActiveTris;  /// Triangles not emitted yet. They are kept at the front of its list.
+    int32_t     CachePos;       /// -1 if not in the cache
+};
+
+float VertexScore(const ForsythVertex& vertex)
+{
+    /// No triangle needs it any more
+    if(vertex.NumActiveTris == 0)
+        return -1.f;
+
+    float score = 0.f;
+    if(vertex.CachePos >= 0)
+    {
+        /// Vertices of the last triangle are scored the same, whatever order they were used in
+        if(vertex.CachePos < 3)
+            score = FORSYTH_LAST_TRI_SCORE;
+        else
+            score = powf(1.f - (float)(vertex.CachePos - 3) / (MESH_OPTIMIZER_CACHE_SIZE - 3), FORSYTH_CACHE_DECAY_POWER);
+    }
+
+    /// Vertices with few triangles left are finished first, so they do not become lonely misses later
+    return score + FORSYTH_VALENCE_BOOST_SCALE * powf((float)vertex.NumActiveTris, -FORSYTH_VALENCE_BOOST_POWER);
+}
+
+/**
+ * @brief   Sum of squared distances to planes, weighted by the areas of their triangles
+ *          The symmetric 4x4 matrix is kept as its upper triangle: xx xy xz xw yy yz yw zz zw ww.
+ */
+struct Quadric
+{
+    double  A[10];
+    double  Weight;
+};
+
+void AddPlane(Quadric& q, const glm::vec3& normal, float distance, double weight)
+{
+    double plane[4] = { normal.x, normal.y, normal.z, distance };
+    uint32_t k = 0;
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        for(uint32_t j = i; j < 4; j++)
+            q.A[k++] += weight * plane[i] * plane[j];
+    }
+    q.Weight += weight;
+}
+
+void AddQuadric(Quadric& q, const Quadric& other)
+{
+    for(uint32_t i = 0; i < 10; i++)
+        q.A[i] += other.A[i];
+    q.Weight += other.Weight;
+}
+
+/// Mean squared distance from a point to the planes of both quadrics
+float QuadricError(const Quadric& q0, const Quadric& q1, const glm::vec3& p)
+{
+    double a[10];
+    for(uint32_t i = 0; i < 10; i++)
+        a[i] = q0.A[i] + q1.A[i];
+
+    double x = p.x, y = p.y, z = p.z;
+    double error = a[0] * x * x + 2.0 * a[1] * x * y + 2.0 * a[2] * x * z + 2.0 * a[3] * x
+                 + a[4] * y * y + 2.0 * a[5] * y * z + 2.0 * a[6] * y
+                 + a[7] * z * z + 2.0 * a[8] * z
+                 + a[9];
+
+    double weight = q0.Weight + q1.Weight;
+    return (weight > 0.0) ? (float)(fabs(error) / weight) : 0.f;
+}
+
+struct Collapse
+{
+    GLuint  From;
+    GLuint  To;
+    float   Error;      /// Squared distance
+
+    bool operator<(const Collapse& other) const { return Error < other.Error; }
+};
+
+/**
+ * @brief   Check the triangles around "from" are still fine after moving it onto "to"
+ *          The collapse must not flip a triangle, and the two vertices must not share a neighbour
+ *          other than the opposite vertices of their common triangles, which would pinch the surface.
+ */
+bool IsCollapseValid(const vector<Vertex>& vertices, const vector<GLuint>& indices,
+                     const vector<uint32_t>& adjOffset, const vector<uint32_t>& adjTris, GLuint from, GLuint to)
+{
+    GLuint opposites[2];
+    uint32_t numShared = 0;
+
+    for(uint32_t i = adjOffset[from]; i < adjOffset[from + 1]; i++)
+    {
+        const GLuint* tri = &indices[adjTris[i] * 3];
+        if(tri[0] == to || tri[1] == to || tri[2] == to)
+        {
+            if(numShared == 2)
+                return false;
+            opposites[numShared++] = tri[0] ^ tri[1] ^ tri[2] ^ from ^ to;
+            continue;
+        }
+
+        glm::vec3 p[3], moved[3];
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            p[k] = vertices[tri[k]].Position;
+            moved[k] = (tri[k] == from) ? vertices[to].Position : p[k];
+        }
+
+        glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+        glm::vec3 movedNormal = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+        if(glm::dot(normal, movedNormal) <= 0.f)
+            return false;
+    }
+
+    /// An interior edge has two triangles
+    if(numShared != 2)
+        return false;
+
+    for(uint32_t i = adjOffset[from]; i < adjOffset[from + 1]; i++)
+    {
+        const GLuint* tri = &indices[adjTris[i] * 3];
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            GLuint v = tri[k];
+            if(v == from || v == to || v == opposites[0] || v == opposites[1])
+                continue;
+
+            for(uint32_t j = adjOffset[to]; j < adjOffset[to + 1]; j++)
+            {
+                const GLuint* toTri = &indices[adjTris[j] * 3];
+                if(toTri[0] == v || toTri[1] == v || toTri[2] == v)
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+}   /// namespace
+
+uint32_t WeldVertices(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    if(vertices.empty())
+        return 0;
+
+    /// Open addressing table of unique vertex indices
+    uint32_t tableSize = 1;
+    while(tableSize < vertices.size() * 2)
+        tableSize <<= 1;
+    vector<uint32_t> table(tableSize, ~0u);
+
+    vector<GLuint> remap(vertices.size());
+    uint32_t numUnique = 0;
+
+    for(uint32_t i = 0; i < vertices.size(); i++)
+    {
+        uint32_t slot = HashVertex(vertices[i]) & (tableSize - 1);
+        while(table[slot] != ~0u && memcmp(&vertices[table[slot]], &vertices[i], sizeof(Vertex)) != 0)
+            slot = (slot + 1) & (tableSize - 1);
+
+        if(table[slot] == ~0u)
+        {
+            /// Unique vertices move forward in place. A slot always refers to a moved vertex.
+            vertices[numUnique] = vertices[i];
+            table[slot] = numUnique++;
+        }
+        remap[i] = table[slot];
+    }
+
+    for(uint32_t i = 0; i < indices.size(); i++)
+        indices[i] = remap[indices[i]];
+
+    vertices.resize(numUnique);
+    return numUnique;
+}
+
+void OptimizeVertexCache(vector<GLuint>& indices, uint32_t numVertices)
+{
+    uint32_t numTris = indices.size() / 3;
+    if(numTris == 0)
+        return;
+
+    /// Triangles of each vertex
+    ForsythVertex initVertex = { 0.f, 0, 0, -1 };
+    vector<ForsythVertex> vertices(numVertices, initVertex);
+    for(uint32_t i = 0; i < indices.size(); i++)
+        vertices[indices[i]].NumActiveTris++;
+
+    uint32_t offset = 0;
+    for(uint32_t i = 0; i < numVertices; i++)
+    {
+        vertices[i].FirstTri = offset;
+        offset += vertices[i].NumActiveTris;
+        vertices[i].Score = VertexScore(vertices[i]);
+    }
+
+    vector<uint32_t> triList(indices.size());
+    vector<uint32_t> fill(numVertices, 0);
+    for(uint32_t i = 0; i < indices.size(); i++)
+    {
+        GLuint v = indices[i];
+        triList[vertices[v].FirstTri + fill[v]++] = i / 3;
+    }
+
+    vector<float> triScores(numTris);
+    vector<bool> isEmitted(numTris, false);
+    int32_t bestTri = 0;
+    for(uint32_t t = 0; t < numTris; t++)
+    {
+        triScores[t] = vertices[indices[t * 3]].Score + vertices[indices[t * 3 + 1]].Score + vertices[indices[t * 3 + 2]].Score;
+        if(triScores[t] > triScores[bestTri])
+            bestTri = t;
+    }
+
+    vector<GLuint> output;
+    output.reserve(indices.size());
+
+    uint32_t cache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+    uint32_t cacheSize = 0;
+    uint32_t nextScan = 0;
+
+    for(uint32_t n = 0; n < numTris; n++)
+    {
+        /// Nothing in the cache has triangles left. Start again from any triangle.
+        if(bestTri < 0)
+        {
+            while(isEmitted[nextScan])
+                nextScan++;
+            bestTri = nextScan;
+        }
+
+        const GLuint* tri = &indices[bestTri * 3];
+        output.insert(output.end(), tri, tri + 3);
+        isEmitted[bestTri] = true;
+
+        /// Move the triangle out of the active part of its vertices' lists
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            ForsythVertex& vertex = vertices[tri[k]];
+            uint32_t* list = &triList[vertex.FirstTri];
+            for(uint32_t j = 0; j < vertex.NumActiveTris; j++)
+            {
+                if(list[j] == (uint32_t)bestTri)
+                {
+                    std::swap(list[j], list[vertex.NumActiveTris - 1]);
+                    break;
+                }
+            }
+            vertex.NumActiveTris--;
+        }
+
+        /// The triangle's vertices go to the front and push the others back
+        uint32_t newCache[MESH_OPTIMIZER_CACHE_SIZE + 3];
+        uint32_t newCacheSize = 0;
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            if(std::find(newCache, newCache + newCacheSize, tri[k]) == newCache + newCacheSize)
+                newCache[newCacheSize++] = tri[k];
+        }
+        for(uint32_t i = 0; i < cacheSize; i++)
+        {
+            if(cache[i] != tri[0] && cache[i] != tri[1] && cache[i] != tri[2])
+                newCache[newCacheSize++] = cache[i];
+        }
+
+        /// Vertices pushed past the end are evicted
+        for(uint32_t i = 0; i < newCacheSize; i++)
+        {
+            ForsythVertex& vertex = vertices[newCache[i]];
+            vertex.CachePos = (i < MESH_OPTIMIZER_CACHE_SIZE) ? i : -1;
+            vertex.Score = VertexScore(vertex);
+        }
+
+        /// Only triangles around the cache changed their scores
+        float bestScore = -1.f;
+        bestTri = -1;
+        for(uint32_t i = 0; i < newCacheSize; i++)
+        {
+            const ForsythVertex& vertex = vertices[newCache[i]];
+            const uint32_t* list = &triList[vertex.FirstTri];
+            for(uint32_t j = 0; j < vertex.NumActiveTris; j++)
+            {
+                uint32_t t = list[j];
+                triScores[t] = vertices[indices[t * 3]].Score + vertices[indices[t * 3 + 1]].Score + vertices[indices[t * 3 + 2]].Score;
+                if(triScores[t] > bestScore)
+                {
+                    bestScore = triScores[t];
+                    bestTri = t;
+                }
+            }
+        }
+
+        cacheSize = std::min(newCacheSize, (uint32_t)MESH_OPTIMIZER_CACHE_SIZE);
+        std::copy(newCache, newCache + cacheSize, cache);
+    }
+
+    indices.swap(output);
+}
+
+void OptimizeVertexFetch(vector<Vertex>& vertices, vector<GLuint>& indices)
+{
+    vector<GLuint> remap(vertices.size(), ~0u);
+    uint32_t numUsed = 0;
+
+    for(uint32_t i = 0; i < indices.size(); i++)
+    {
+        GLuint& index = indices[i];
+        if(remap[index] == ~0u)
+            remap[index] = numUsed++;
+        index = remap[index];
+    }
+
+    vector<Vertex> reordered(numUsed);
+    for(uint32_t i = 0; i < vertices.size(); i++)
+    {
+        if(remap[i] != ~0u)
+            reordered[remap[i]] = vertices[i];
+    }
+
+    vertices.swap(reordered);
+}
+
+float CalcAcmr(const vector<GLuint>& indices, uint32_t numVertices, uint32_t cacheSize)
+{
+    uint32_t numTris = indices.size() / 3;
+    if(numTris == 0)
+        return 0.f;
+
+    /// A vertex is in the FIFO if fewer than "cacheSize" misses happened after it was loaded
+    vector<uint32_t> loadedAt(numVertices, 0);
+    uint32_t numMisses = 0;
+
+    for(uint32_t i = 0; i < indices.size(); i++)
+    {
+        GLuint v = indices[i];
+        if(loadedAt[v] == 0 || numMisses - loadedAt[v] >= cacheSize)
+            loadedAt[v] = ++numMisses;
+    }
+
+    return (float)numMisses / numTris;
+}
+
+void OptimizeMesh(MeshData& mesh)
+{
+    if(mesh.Vertices.empty() || mesh.Indices.empty())
+        return;
+
+    uint32_t numVertices = mesh.Vertices.size();
+    float acmrBefore = CalcAcmr(mesh.Indices, numVertices);
+
+    WeldVertices(mesh.Vertices, mesh.Indices);
+    OptimizeVertexCache(mesh.Indices, mesh.Vertices.size());
+    OptimizeVertexFetch(mesh.Vertices, mesh.Indices);
+
+    float acmrAfter = CalcAcmr(mesh.Indices, mesh.Vertices.size());
+
+    Log("[MeshOptimizer] %u -> %u vertices, %u triangles, ACMR %.3f -> %.3f \n", numVertices,
+        (uint32_t)mesh.Vertices.size(), (uint32_t)(mesh.Indices.size() / 3), acmrBefore, acmrAfter);
+}
+
+vector<GLuint> SimplifyMesh(const vector<Vertex>& vertices, const vector<GLuint>& indices,
+                            size_t targetIndexCount, float maxError, float& error)
+{
+    uint32_t numVertices = vertices.size();
+    vector<GLuint> result(indices);
+    error = 0.f;
+
+    if(result.size() <= targetIndexCount)
+        return result;
+
+    /// Vertices at the same position differ in attributes. Each group shares the first one as a representative.
+    vector<GLuint> order(numVertices);
+    for(GLuint i = 0; i < numVertices; i++)
+        order[i] = i;
+
+    auto lessPosition = [&vertices](GLuint a, GLuint b)
+    {
+        const glm::vec3& pa = vertices[a].Position;
+        const glm::vec3& pb = vertices[b].Position;
+        return (pa.x != pb.x) ? pa.x < pb.x : (pa.y != pb.y) ? pa.y < pb.y : pa.z < pb.z;
+    };
+    std::sort(order.begin(), order.end(), lessPosition);
+
+    vector<GLuint> posRep(numVertices);
+    vector<bool> isLocked(numVertices, false);
+    for(GLuint i = 0; i < numVertices; )
+    {
+        GLuint end = i + 1;
+        while(end < numVertices && vertices[order[end]].Position == vertices[order[i]].Position)
+            end++;
+
+        /// Moving a seam vertex would tear the texture along the seam
+        for(GLuint j = i; j < end; j++)
+        {
+            posRep[order[j]] = order[i];
+            isLocked[order[j]] = (end - i > 1);
+        }
+        i = end;
+    }
+
+    /// An edge whose reverse is not used by another triangle is on a border
+    vector<uint64_t> edges;
+    edges.reserve(result.size());
+    for(size_t i = 0; i < result.size(); i += 3)
+    {
+        for(uint32_t k = 0; k < 3; k++)
+        {
+            uint64_t a = posRep[result[i + k]], b = posRep[result[i + (k + 1) % 3]];
+            edges.push_back((a << 32) | b);
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+
+    vector<bool> isBorder(numVertices, false);
+    for(size_t i = 0; i < edges.size(); i++)
+    {
+        uint64_t reverse = (edges[i] << 32) | (edges[i] >> 32);
+        bool isDuplicated = (i > 0 && edges[i - 1] == edges[i]) || (i + 1 < edges.size() && edges[i + 1] == edges[i]);
+        if(isDuplicated || !std::binary_search(edges.begin(), edges.end(), reverse))
+        {
+            isBorder[edges[i] >> 32] = true;
+            isBorder[edges[i] & 0xFFFFFFFFu] = true;
+        }
+    }
+
+    for(GLuint i = 0; i < numVertices; i++)
+    {
+        if(isBorder[posRep[i]])
+            isLocked[i] = true;
+    }
+
+    /// Planes of the original triangles around each position
+    Quadric zero;
+    memset(&zero, 0, sizeof(zero));
+    vector<Quadric> quadrics(numVertices, zero);
+    for(size_t i = 0; i < result.size(); i += 3)
+    {
+        const glm::vec3& p0 = vertices[result[i]].Position;
+        glm::vec3 normal = glm::cross(vertices[result[i + 1]].Position - p0, vertices[result[i + 2]].Position - p0);
+        float length = glm::length(normal);
+        if(length == 0.f)
+            continue;
+
+        normal /= length;
+        float distance = -glm::dot(normal, p0);
+        for(uint32_t k = 0; k < 3; k++)
+            AddPlane(quadrics[posRep[result[i + k]]], normal, distance, length * 0.5f);
+    }
+
+    float maxError2 = maxError * maxError;
+    vector<Collapse> collapses;
+    vector<uint32_t> adjOffset(numVertices + 1), adjTris;
+    vector<bool> isTouched(numVertices);
+    vector<GLuint> remap(numVertices);
+
+    for(uint32_t pass = 0; pass < SIMPLIFY_MAX_PASSES && result.size() > targetIndexCount; pass++)
+    {
+        /// Triangles of each vertex
+        std::fill(adjOffset.begin(), adjOffset.end(), 0);
+        for(size_t i = 0; i < result.size(); i++)
+            adjOffset[result[i] + 1]++;
+        for(GLuint i = 0; i < numVertices; i++)
+            adjOffset[i + 1] += adjOffset[i];
+
+        adjTris.resize(result.size());
+        vector<uint32_t> fill(adjOffset.begin(), adjOffset.end() - 1);
+        for(size_t i = 0; i < result.size(); i++)
+            adjTris[fill[result[i]]++] = i / 3;
+
+        /// Both directions of every edge from a vertex allowed to move
+        collapses.clear();
+        for(size_t i = 0; i < result.size(); i += 3)
+        {
+            for(uint32_t k = 0; k < 3; k++)
+            {
+                GLuint a = result[i + k], b = result[i + (k + 1) % 3];
+                const Quadric& qa = quadrics[posRep[a]];
+                const Quadric& qb = quadrics[posRep[b]];
+                if(!isLocked[a])
+                    collapses.push_back({ a, b, QuadricError(qa, qb, vertices[b].Position) });
+                if(!isLocked[b])
+                    collapses.push_back({ b, a, QuadricError(qa, qb, vertices[a].Position) });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        /// Cheapest collapses first. A collapse freezes the triangles around it until the next pass.
+        size_t numRemovable = (result.size() - targetIndexCount) / 3;
+        size_t numRemoved = 0;
+        uint32_t numCollapses = 0;
+        std::fill(isTouched.begin(), isTouched.end(), false);
+        for(GLuint i = 0; i < numVertices; i++)
+            remap[i] = i;
+
+        for(size_t i = 0; i < collapses.size() && numRemoved < numRemovable; i++)
+        {
+            const Collapse& collapse = collapses[i];
+            if(collapse.Error > maxError2)
+                break;
+
+            if(isTouched[collapse.From] || isTouched[collapse.To])
+                continue;
+
+            if(!IsCollapseValid(vertices, result, adjOffset, adjTris, collapse.From, collapse.To))
+                continue;
+
+            for(uint32_t j = adjOffset[collapse.From]; j < adjOffset[collapse.From + 1]; j++)
+            {
+                const GLuint* tri = &result[adjTris[j] * 3];
+                isTouched[tri[0]] = isTouched[tri[1]] = isTouched[tri[2]] = true;
+            }
+
+            remap[collapse.From] = collapse.To;
+            AddQuadric(quadrics[posRep[collapse.To]], quadrics[posRep[collapse.From]]);
+            error = std::max(error, collapse.Error);
+            numRemoved += 2;
+            numCollapses++;
+        }
+
+        if(numCollapses == 0)
+            break;
+
+        /// Triangles collapsed to a line disappear
+        size_t numIndices = 0;
+        for(size_t i = 0; i < result.size(); i += 3)
+        {
+            GLuint a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+            if(a == b || b == c || c == a)
+                continue;
+
+            result[numIndices++] = a;
+            result[numIndices++] = b;
+            result[numIndices++] = c;
+        }
+        result.resize(numIndices);
+    }
+
+    error = sqrtf(error);
+    return result;
+}
+
+void BuildMeshLods(MeshData& mesh, uint32_t numLevels)
+{
+    mesh.Lods.clear();
+    if(mesh.Vertices.empty() || mesh.Indices.empty())
+        return;
+
+    glm::vec3 minPos = mesh.Vertices[0].Position;
+    glm::vec3 maxPos = mesh.Vertices[0].Position;
+    for(GLuint i = 1; i < mesh.Vertices.size(); i++)
+    {
+        minPos = glm::min(minPos, mesh.Vertices[i].Position);
+        maxPos = glm::max(maxPos, mesh.Vertices[i].Position);
+    }
+    float maxError = glm::length(maxPos - minPos) * 0.5f * MESH_LOD_MAX_ERROR;
+
+    MeshLod fullDetail = { 0, (GLuint)mesh.Indices.size(), 0.f };
+    mesh.Lods.push_back(fullDetail);
+
+    vector<GLuint> allIndices(mesh.Indices);
+    vector<GLuint> prevIndices;
+    prevIndices.swap(mesh.Indices);
+
+    size_t targetIndexCount = prevIndices.size();
+    float prevError = 0.f;
+
+    for(uint32_t level = 1; level < numLevels; level++)
+    {
+        targetIndexCount = (size_t)(targetIndexCount * MESH_LOD_REDUCTION) / 3 * 3;
+        if(targetIndexCount < MESH_LOD_MIN_TRIANGLES * 3)
+            break;
+
+        float error;
+        vector<GLuint> indices = SimplifyMesh(mesh.Vertices, prevIndices, targetIndexCount, maxError - prevError, error);
+
+        /// Locked borders and seams can stop the reduction early
+        if(indices.size() > prevIndices.size() * LOD_MIN_REDUCTION)
+            break;
+
+        OptimizeVertexCache(indices, mesh.Vertices.size());
+
+        /// Errors of the levels add up, as each one is simplified from the previous one
+        prevError += error;
+        MeshLod lod = { (GLuint)allIndices.size(), (GLuint)indices.size(), prevError };
+        mesh.Lods.push_back(lod);
+        allIndices.insert(allIndices.end(), indices.begin(), indices.end());
+
+        Log("[MeshOptimizer] LOD %u: %u triangles, error %f \n", level, (uint32_t)(indices.size() / 3), prevError);
+        prevIndices.swap(indices);
+    }
+
+    mesh.Indices.swap(allIndices);
+}
+
+}   /// namespace gl
@@ -3,9 +3,15 @@
 #include <sstream>
 #include <iostream>
 #include <map>
-#include <SOIL.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "model.h"
 #include "logging.h"
+#include "meshOptimizer.h"
 
 namespace gl
 {
@@ -15,12 +21,97 @@ using namespace std;
 Model::Model(const char* path)
 {
     _modelPath = string(path);
+    _isMeshOptimized = true;
+    _numLodLevels = MESH_LOD_MAX_LEVELS;
+    _isBvhBuilt = true;
     _meshes.clear();
     _texturesCache.clear();
 }
 
+namespace
+{
+
+/**
+ * @brief   Calculate FNV-1a hash of a file
+ *
+ * @param path      file path
+ * @param hash      calculated hash
+ * @return  result of function
+ */
+bool hashFile(const char* path, uint64_t& hash)
+{
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    hash = 14695981039346656037ULL;
+    if(st.st_size > 0)
+    {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED)
+        {
+            close(fd);
+            return false;
+        }
+
+        const unsigned char* bytes = (const unsigned char*)data;
+        for(off_t i = 0; i < st.st_size; i++)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        munmap(data, st.st_size);
+    }
+
+    close(fd);
+    return true;
+}
+
+/**
+ * @brief   Read sequentially from a memory mapped cache with bounds check
+ */
+struct CacheReader
+{
+    const char* Cur;
+    const char* End;
+
+    bool Read(void* dst, size_t size)
+    {
+        if((size_t)(End - Cur) < size)
+            return false;
+        memcpy(dst, Cur, size);
+        Cur += size;
+        return true;
+    }
+
+    /// Checks an array fits in the rest of the cache before it is allocated
+    bool Has(uint64_t count, size_t size) const
+    {
+        return count <= (uint64_t)(End - Cur) / size;
+    }
+};
+
+} /// namespace
+
 bool Model::Parse()
 {
+    /// store the directory of the file
+    _directory = _modelPath.substr(0, _modelPath.find_last_of('/'));
+
+    /// Warm start skips parsing the model file
+    if(loadMeshCache())
+    {
+        Log("[Model][Parse] %d meshes are loaded from cache (%s%s) \n", (int)_meshes.size(), _modelPath.c_str(), MESH_CACHE_EXT);
+        return true;
+    }
+
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(_modelPath, aiProcess_Triangulate | aiProcess_FlipUVs);
     if(!scene || scene->mFlags == AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
@@ -29,14 +120,271 @@ bool Model::Parse()
         return false;
     }
 
-    /// store the directory of the file
-    _directory = _modelPath.substr(0, _modelPath.find_last_of('/'));
     Log("[Model][Parse] the directory path of model file (%s) \n", _directory.c_str());
 
     /// Parses all nodes in the scene
     parseNodeData(scene->mRootNode, scene);
 
-    Log("[DEBUG] end of parseNodeData \n");
+    LogDebug("end of parseNodeData \n");
+
+    /// The BVH and the cache are made from the optimized order
+    if(_isMeshOptimized)
+    {
+        for(GLuint i = 0; i < _meshes.size(); i++)
+            OptimizeMesh(_meshes[i]);
+    }
+
+    /// Coarser levels are appended after the full detail
+    if(_numLodLevels > 1)
+    {
+        for(GLuint i = 0; i < _meshes.size(); i++)
+            BuildMeshLods(_meshes[i], _numLodLevels);
+    }
+
+    if(_isBvhBuilt)
+        buildMeshBvh();
+
+    /// Next launch reads the cache instead
+    if(!saveMeshCache())
+        Log("[Model][Parse] fail to write mesh cache of %s \n", _modelPath.c_str());
+
+    return true;
+}
+
+void Model::buildMeshBvh()
+{
+    double startTime = glfwGetTime();
+    for(GLuint i = 0; i < _meshes.size(); i++)
+    {
+        MeshData& mesh = _meshes[i];
+        if(mesh.Vertices.empty())
+            continue;
+
+        /// Picking tests the full detail only
+        GLuint numIndices = mesh.Lods.empty() ? mesh.Indices.size() : mesh.Lods[0].IndexCount;
+        mesh.Bvh.Build(&mesh.Vertices[0].Position.x, sizeof(Vertex), mesh.Indices.data(), numIndices);
+    }
+    Log("[Model][buildMeshBvh] %.1f ms for %d meshes \n", (glfwGetTime() - startTime) * 1000.0, (int)_meshes.size());
+}
+
+bool Model::loadMeshCache()
+{
+    string cachePath = _modelPath + MESH_CACHE_EXT;
+
+    struct stat srcStat;
+    if(stat(_modelPath.c_str(), &srcStat) != 0)
+        return false;
+
+    int fd = open(cachePath.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat cacheStat;
+    if(fstat(fd, &cacheStat) != 0 || cacheStat.st_size < (off_t)sizeof(MeshCacheHeader))
+    {
+        close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, cacheStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return false;
+
+    CacheReader reader = { (const char*)data, (const char*)data + cacheStat.st_size };
+    vector<MeshData> meshes;
+    bool result = false;
+
+    do {
+        MeshCacheHeader header;
+        if(!reader.Read(&header, sizeof(header)))
+            break;
+
+        if(header.Magic != MESH_CACHE_MAGIC || header.Version != MESH_CACHE_VERSION)
+        {
+            Log("[Model][loadMeshCache] cache version mismatch (%s) \n", cachePath.c_str());
+            break;
+        }
+
+        if(header.IsOptimized != (uint32_t)_isMeshOptimized || header.NumLodLevels != _numLodLevels
+           || header.IsBvhBuilt != (uint32_t)_isBvhBuilt)
+            break;
+
+        string path(header.PathLength, '\0');
+        if(!reader.Read(&path[0], header.PathLength) || path != _modelPath)
+            break;
+
+        if(header.SourceSize != (uint64_t)srcStat.st_size)
+            break;
+
+        /// Model file touched without changes still uses the cache
+        if(header.SourceMtime != (int64_t)srcStat.st_mtime)
+        {
+            uint64_t hash;
+            if(!hashFile(_modelPath.c_str(), hash) || hash != header.SourceHash)
+                break;
+        }
+
+        bool isValid = true;
+        for(GLuint i = 0; i < header.NumMeshes && isValid; i++)
+        {
+            MeshCacheMesh meshHeader;
+            if(!reader.Read(&meshHeader, sizeof(meshHeader)))
+            {
+                isValid = false;
+                break;
+            }
+
+            /// Counts of a broken cache must not allocate more than the file holds
+            vector<Vertex> vertices;
+            vector<GLuint> indices;
+            vector<MeshLod> lods;
+            vector<Texture> textures;
+
+            isValid = meshHeader.NumVertices > 0 && reader.Has(meshHeader.NumVertices, sizeof(Vertex));
+            if(isValid)
+            {
+                vertices.resize(meshHeader.NumVertices);
+                isValid = reader.Read(vertices.data(), vertices.size() * sizeof(Vertex))
+                          && meshHeader.NumIndices > 0 && reader.Has(meshHeader.NumIndices, sizeof(GLuint));
+            }
+            if(isValid)
+            {
+                indices.resize(meshHeader.NumIndices);
+                isValid = reader.Read(indices.data(), indices.size() * sizeof(GLuint))
+                          && reader.Has(meshHeader.NumLods, sizeof(MeshLod));
+            }
+
+            /// Every index must address a vertex, or drawing and picking read past the vertices
+            for(GLuint j = 0; j < indices.size() && isValid; j++)
+                isValid = indices[j] < meshHeader.NumVertices;
+            if(isValid)
+            {
+                lods.resize(meshHeader.NumLods);
+                isValid = reader.Read(lods.data(), lods.size() * sizeof(MeshLod));
+            }
+
+            /// Every level draws a range of the index array
+            for(GLuint j = 0; j < lods.size() && isValid; j++)
+                isValid = (uint64_t)lods[j].FirstIndex + lods[j].IndexCount <= meshHeader.NumIndices;
+
+            for(GLuint j = 0; j < meshHeader.NumTextures && isValid; j++)
+            {
+                uint32_t type, length;
+                isValid = reader.Read(&type, sizeof(type)) && reader.Read(&length, sizeof(length))
+                          && reader.Has(length, 1);
+                if(!isValid)
+                    break;
+
+                string texPath(length, '\0');
+                isValid = reader.Read(&texPath[0], length);
+                if(isValid)
+                    textures.push_back(getTexture(texPath.c_str(), (TexType)type));
+            }
+
+            if(!isValid)
+                break;
+
+            MeshData mesh(std::move(vertices), std::move(indices), std::move(textures));
+            mesh.Lods = std::move(lods);
+            isValid = reader.Has(meshHeader.NumBvhNodes, sizeof(MeshBvhNode));
+            if(isValid)
+            {
+                mesh.Bvh.Nodes.resize(meshHeader.NumBvhNodes);
+                isValid = reader.Read(mesh.Bvh.Nodes.data(), mesh.Bvh.Nodes.size() * sizeof(MeshBvhNode))
+                          && reader.Has(meshHeader.NumBvhTriangles, sizeof(MeshBvhTriangle));
+            }
+            if(isValid)
+            {
+                mesh.Bvh.Triangles.resize(meshHeader.NumBvhTriangles);
+                isValid = reader.Read(mesh.Bvh.Triangles.data(), mesh.Bvh.Triangles.size() * sizeof(MeshBvhTriangle))
+                          && mesh.Bvh.IsValid();
+            }
+
+            if(isValid)
+                meshes.push_back(std::move(mesh));
+        }
+
+        if(!isValid)
+        {
+            LogError("[Model][loadMeshCache] broken cache file (%s) \n", cachePath.c_str());
+            break;
+        }
+
+        _meshes = std::move(meshes);
+        result = true;
+    } while(0);
+
+    munmap(data, cacheStat.st_size);
+    return result;
+}
+
+bool Model::saveMeshCache()
+{
+    string cachePath = _modelPath + MESH_CACHE_EXT;
+    string tempPath = cachePath + ".tmp";
+
+    struct stat srcStat;
+    MeshCacheHeader header;
+    if(stat(_modelPath.c_str(), &srcStat) != 0 || !hashFile(_modelPath.c_str(), header.SourceHash))
+        return false;
+
+    header.Magic = MESH_CACHE_MAGIC;
+    header.Version = MESH_CACHE_VERSION;
+    header.SourceSize = srcStat.st_size;
+    header.SourceMtime = srcStat.st_mtime;
+    header.PathLength = _modelPath.size();
+    header.NumMeshes = _meshes.size();
+    header.IsOptimized = _isMeshOptimized;
+    header.NumLodLevels = _numLodLevels;
+    header.IsBvhBuilt = _isBvhBuilt;
+
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if(!file)
+        return false;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(_modelPath.data(), 1, header.PathLength, file) == header.PathLength;
+
+    for(GLuint i = 0; i < _meshes.size() && result; i++)
+    {
+        const MeshData& mesh = _meshes[i];
+        MeshCacheMesh meshHeader;
+        meshHeader.NumVertices = mesh.Vertices.size();
+        meshHeader.NumIndices = mesh.Indices.size();
+        meshHeader.NumLods = mesh.Lods.size();
+        meshHeader.NumTextures = mesh.Textures.size();
+        meshHeader.NumBvhNodes = mesh.Bvh.Nodes.size();
+        meshHeader.NumBvhTriangles = mesh.Bvh.Triangles.size();
+
+        result = fwrite(&meshHeader, sizeof(meshHeader), 1, file) == 1
+                 && fwrite(mesh.Vertices.data(), sizeof(Vertex), mesh.Vertices.size(), file) == mesh.Vertices.size()
+                 && fwrite(mesh.Indices.data(), sizeof(GLuint), mesh.Indices.size(), file) == mesh.Indices.size()
+                 && fwrite(mesh.Lods.data(), sizeof(MeshLod), mesh.Lods.size(), file) == mesh.Lods.size();
+
+        for(GLuint j = 0; j < mesh.Textures.size() && result; j++)
+        {
+            uint32_t type = mesh.Textures[j].type;
+            uint32_t length = mesh.Textures[j].path.size();
+            result = fwrite(&type, sizeof(type), 1, file) == 1
+                     && fwrite(&length, sizeof(length), 1, file) == 1
+                     && fwrite(mesh.Textures[j].path.data(), 1, length, file) == length;
+        }
+
+        result = result
+                 && fwrite(mesh.Bvh.Nodes.data(), sizeof(MeshBvhNode), mesh.Bvh.Nodes.size(), file) == mesh.Bvh.Nodes.size()
+                 && fwrite(mesh.Bvh.Triangles.data(), sizeof(MeshBvhTriangle), mesh.Bvh.Triangles.size(), file) == mesh.Bvh.Triangles.size();
+    }
+
+    if(fclose(file) != 0)
+        result = false;
+
+    /// Readers never see a partially written cache
+    if(!result || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
 
     return true;
 }
@@ -44,17 +392,24 @@ bool Model::Parse()
 bool Model::parseNodeData(aiNode* node, const aiScene* scene)
 {
     /// Extracts all mesh object in this node.
-    Log("[DEBUG] mNumMeshes %d \n", node->mNumMeshes);
+    LogDebug("mNumMeshes %d \n", node->mNumMeshes);
 
     for(GLuint i = 0; i < node->mNumMeshes; i++)
     {
         /// The node object only contains index to the actual objects in the scene.
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        MeshData data = parseMeshData(mesh, scene);
-        _meshes.push_back(data);
+        MeshData meshData = parseMeshData(mesh, scene);
+
+        /// Nothing can be drawn or picked without triangles
+        if(meshData.Vertices.empty() || meshData.Indices.empty())
+        {
+            Log("[Model][parseNodeData] skip an empty mesh of %s \n", _modelPath.c_str());
+            continue;
+        }
+        _meshes.push_back(std::move(meshData));
     }
 
-    Log("[DEBUG] mNumChildren %d \n", node->mNumChildren);
+    LogDebug("mNumChildren %d \n", node->mNumChildren);
 
     /// Parses all children nodes
     for(GLuint i = 0; i < node->mNumChildren; i++)
@@ -65,12 +420,16 @@ bool Model::parseNodeData(aiNode* node, const aiScene* scene)
 
 MeshData Model::parseMeshData(aiMesh* mesh, const aiScene* scene)
 {
-    Log("[DEBUG] start parseMeshData %d vertices \n", mesh->mNumVertices);
+    LogDebug("start parseMeshData %d vertices \n", mesh->mNumVertices);
 
     vector<Vertex> vertices;
     vector<GLuint> indices;
     vector<Texture> textures;
 
+    /// Faces are triangulated by Assimp
+    vertices.reserve(mesh->mNumVertices);
+    indices.reserve(mesh->mNumFaces * 3);
+
     /// Extracts vertex information
     for(GLuint i = 0; i < mesh->mNumVertices; i++)
     {
@@ -100,66 +459,72 @@ MeshData Model::parseMeshData(aiMesh* mesh, const aiScene* scene)
         vertices.push_back(vert);
     }
 
-    Log("[DEBUG] mNumFaces %d \n", mesh->mNumFaces);
+    LogDebug("mNumFaces %d \n", mesh->mNumFaces);
     /// Extracts index information
+    /// Points and lines are left after triangulation, and they are not drawn as triangles
     for(GLuint i = 0; i < mesh->mNumFaces; i++)
     {
         aiFace face = mesh->mFaces[i];
+        if(face.mNumIndices != 3)
+            continue;
         for(GLuint j = 0; j < face.mNumIndices; j++)
             indices.push_back(face.mIndices[j]);
     }
 
-    Log("[DEBUG] mMaterialIndex %d \n", mesh->mMaterialIndex);
+    LogDebug("mMaterialIndex %d \n", mesh->mMaterialIndex);
     /// Extracts material information
     if(mesh->mMaterialIndex >= 0)
     {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-        printf("[DEBUG] parseTextures aiTextureType_DIFFUSE \n");
+        LogDebug("parseTextures aiTextureType_DIFFUSE \n");
         parseTextures(material, aiTextureType_DIFFUSE, textures);
-        printf("[DEBUG] parseTextures aiTextureType_SPECULAR \n");
+        LogDebug("parseTextures aiTextureType_SPECULAR \n");
         parseTextures(material, aiTextureType_SPECULAR, textures);
     }
 
-    return MeshData(vertices, indices, textures);
+    return MeshData(std::move(vertices), std::move(indices), std::move(textures));
 }
 
 bool Model::parseTextures(aiMaterial* mat, aiTextureType type, vector<Texture>& textures)
 {
-    Log("[DEBUG] parseTextures type %d count %d \n", type, mat->GetTextureCount(type));
+    LogDebug("parseTextures type %d count %d \n", type, mat->GetTextureCount(type));
 
     for(GLuint i = 0; i < mat->GetTextureCount(type); i++)
     {
         aiString str;
         mat->GetTexture(type, i, &str);
 
-        /// Check if there is same texture in the cache
-        GLboolean isThere = false;
-        for(GLuint j = 0; j < _texturesCache.size(); j++)
-        {
-            if(strcmp(_texturesCache[j].path.c_str(), str.C_Str()) == 0)
-            {
-                textures.push_back(_texturesCache[j]);
-                isThere = true;
-                break;
-            }
-        }
-
-        /// In case there is no loaded texture, loads texture from file.
-        if(!isThere)
-        {
-            Texture texture;
-            texture.object = getTextureObjFromFile(str.C_Str(), _directory);
-            texture.type = (type == aiTextureType_DIFFUSE) ? Texture_Diffuse :Texture_Specular;
-            texture.path = string(str.C_Str());
-            textures.push_back(texture);
-            _texturesCache.push_back(texture);
-        }
+        textures.push_back(getTexture(str.C_Str(), (type == aiTextureType_DIFFUSE) ? Texture_Diffuse :Texture_Specular));
     }
 
     return true;
 }
 
-GLint Model::getTextureObjFromFile(const char* path, string directory)
+Texture Model::getTexture(const char* path, TexType type)
+{
+    /// Check if there is same texture in the cache
+    for(GLuint i = 0; i < _texturesCache.size(); i++)
+    {
+        if(strcmp(_texturesCache[i].path.c_str(), path) == 0)
+            return _texturesCache[i];
+    }
+
+    /// In case there is no loaded texture, loads texture from file.
+    /// The texture object is made by "UploadTextures".
+    TextureImage image;
+    loadImage(path, image);
+
+    Texture texture;
+    texture.object = 0;
+    texture.type = type;
+    texture.path = string(path);
+    _texturesCache.push_back(texture);
+    _images.push_back(image);
+
+    return texture;
+}
+
+bool Model::loadImage(const char* path, TextureImage& image)
 {
     /// Make Texture file path
     string texturePath;
@@ -174,46 +539,53 @@ GLint Model::getTextureObjFromFile(const char* path, string directory)
             str += path[i];
     }
 
-    texturePath = directory + '/' + str;
+    texturePath = _directory + '/' + str;
 
-    GLuint textureObj;
-    glGenTextures(1, &textureObj);
+    LogDebug("loadImage %s \n", texturePath.c_str());
 
-    Log("[DEBUG] getTextureObjFromFile %s \n", texturePath.c_str());
+    return LoadTextureImage(texturePath, false, image);
+}
 
-    /// All upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    glBindTexture(GL_TEXTURE_2D, textureObj);
+bool Model::UploadTextures()
+{
+    bool result = true;
 
-    /// Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
+    for(GLuint i = 0; i < _images.size(); i++)
+    {
+        if(_images[i].Levels.empty())
+        {
+            result = result && _texturesCache[i].object != 0;
+            continue;
+        }
 
-    /// Set texture filtering
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        _texturesCache[i].object = CreateTextureObject(_images[i], GL_REPEAT);
+        vector<TextureLevel>().swap(_images[i].Levels);
+        vector<unsigned char>().swap(_images[i].Data);
+    }
 
-    /// Load, create texture and generate mipmaps
-    int width, height;
-    unsigned char* image = SOIL_load_image(texturePath.c_str(), &width, &height, 0, SOIL_LOAD_RGB);
-    if(image == NULL)
+    /// Meshes hold copies of the cache entries
+    for(GLuint i = 0; i < _meshes.size(); i++)
     {
-        LogError("SOIL_load_image fail \n");
-        return -1;
+        vector<Texture>& textures = _meshes[i].Textures;
+        for(GLuint j = 0; j < textures.size(); j++)
+        {
+            for(GLuint k = 0; k < _texturesCache.size(); k++)
+            {
+                if(textures[j].path == _texturesCache[k].path)
+                {
+                    textures[j].object = _texturesCache[k].object;
+                    break;
+                }
+            }
+        }
     }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(image);
-
-    /// Unbind texture when done, so we won't accidentally mess up our texture.
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return textureObj;
+    return result;
 }
 
-vector<MeshData> Model::GetMeshData()
+vector<MeshData> Model::TakeMeshData()
 {
-    return _meshes;
+    return std::move(_meshes);
 }
 
 }
@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <iostream>
@@ -10,10 +11,19 @@
 namespace gl
 {
 
-PlanetObject::PlanetObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures) :
-    MeshObject(pShader, vertices, indices, textures)
+PlanetObject::PlanetObject(Shader* pShader, vector<Vertex> vertices, vector<GLuint> indices, vector<Texture> textures,
+                           GLuint amount) :
+    MeshObject(pShader, std::move(vertices), std::move(indices), std::move(textures))
 {
+    _amount = amount;
     _modelMatrices = nullptr;
+    _instanceVbo = 0;
+    _fieldBound = glm::vec4(0.f);
+
+    _pCullShader = nullptr;
+    _matrixSsbo = 0;
+    _indirectBuffer = 0;
+    _isFieldVisible = true;
 }
 
 PlanetObject::~PlanetObject()
@@ -21,6 +31,15 @@ PlanetObject::~PlanetObject()
     if(_modelMatrices)
         delete[] _modelMatrices;
 
+    if(_instanceVbo)
+        glDeleteBuffers(1, &_instanceVbo);
+
+    if(_matrixSsbo)
+        glDeleteBuffers(1, &_matrixSsbo);
+
+    if(_indirectBuffer)
+        glDeleteBuffers(1, &_indirectBuffer);
+
 }
 
 bool PlanetObject::generateModelMatrix()
@@ -87,21 +106,14 @@ bool PlanetObject::generateModelMatrix()
 
 bool PlanetObject::generateInstanceAttribute()
 {
-    GLuint buffer;
-    glGenBuffers(1, &buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, _amount * sizeof(glm::mat4), &_modelMatrices[0], GL_STATIC_DRAW);
+    /// Filled with visible asteroids every frame. GPU culling keeps a range for each level.
+    GLuint numSlots = _pCullShader ? _amount * min((GLuint)_lods.size(), (GLuint)CULL_MAX_LODS) : _amount;
+    glGenBuffers(1, &_instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, numSlots * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
 
     glBindVertexArray(_vao);
-    /// Set attribute pointers for matrix (4 times vec4)
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)0);
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(sizeof(glm::vec4)));
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(2 * sizeof(glm::vec4)));
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(3 * sizeof(glm::vec4)));
+    setInstanceAttribute(0);
 
     glVertexAttribDivisor(3, 1);
     glVertexAttribDivisor(4, 1);
@@ -109,6 +121,57 @@ bool PlanetObject::generateInstanceAttribute()
     glVertexAttribDivisor(6, 1);
 
     glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void PlanetObject::setInstanceAttribute(GLuint firstInstance)
+{
+    GLsizeiptr offset = firstInstance * sizeof(glm::mat4);
+
+    /// Set attribute pointers for matrix (4 times vec4)
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(offset));
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(offset + sizeof(glm::vec4)));
+    glEnableVertexAttribArray(5);
+    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(offset + 2 * sizeof(glm::vec4)));
+    glEnableVertexAttribArray(6);
+    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (GLvoid*)(offset + 3 * sizeof(glm::vec4)));
+}
+
+bool PlanetObject::generateCullBuffers()
+{
+    /// Source of the compute shader. The instance buffer becomes its output.
+    glGenBuffers(1, &_matrixSsbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, _matrixSsbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, _amount * sizeof(glm::mat4), &_modelMatrices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    /// Each level draws its own index range from its own range of the instance buffer
+    GLuint numLods = min((GLuint)_lods.size(), (GLuint)CULL_MAX_LODS);
+    for(GLuint i = 0; i < numLods; i++)
+    {
+        DrawElementsIndirectCommand command = { _lods[i].IndexCount, 0, _lods[i].FirstIndex, 0, i * _amount };
+        _lodCommands.push_back(command);
+    }
+
+    glGenBuffers(1, &_indirectBuffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, _lodCommands.size() * sizeof(DrawElementsIndirectCommand),
+                 &_lodCommands[0], GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    _cullMLoc = _pCullShader->GetUniform("M");
+    _cullBoundLoc = _pCullShader->GetUniform("boundSphere");
+    _cullCountLoc = _pCullShader->GetUniform("instanceCount");
+    for(GLuint i = 0; i < Frustum::NUM_PLANES; i++)
+        _cullPlaneLocs[i] = _pCullShader->GetUniform("frustumPlanes[" + to_string(i) + "]");
+
+    _cullLodCountLoc = _pCullShader->GetUniform("lodCount");
+    for(GLuint i = 0; i < CULL_MAX_LODS; i++)
+        _cullLodErrorLocs[i] = _pCullShader->GetUniform("lodErrors[" + to_string(i) + "]");
 
     return true;
 }
@@ -119,6 +182,9 @@ bool PlanetObject::Initialize()
     {
         generateModelMatrix();
         generateInstanceAttribute();
+
+        if(_pCullShader)
+            generateCullBuffers();
     }
 
     return true;
@@ -134,42 +200,160 @@ void PlanetObject::GetCurObjectInfo(struct ObjectInfo& objInfo)
     objInfo.ObjType = Object_Planet;
 }
 
-bool PlanetObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+void PlanetObject::GetInstanceInfo(uint32_t index, struct ObjectInfo& objInfo)
 {
-    if(SetTextureToShader() == false)
-        return false;
+    GetCurObjectInfo(objInfo);
+    transformBoundingSphere(_modelMat * _modelMatrices[index], objInfo.CurPos, objInfo.ObjRadius);
+}
+
+void PlanetObject::Update(const double dt, StudioEnv& studioEnv)
+{
+    _time += dt;
 
-    const GLuint program = _pShader->GetProgram();
+    _curPos.x = _T[3][0]; _curPos.y = _T[3][1]; _curPos.z = _T[3][2];
 
-    /// lighting
-    glUniform1f(glGetUniformLocation(program, "textureShininess"), 32.0f);
+    glm::mat4 R(1.0f);
+    _modelMat = _T* R *_S;
+    _normalMat = glm::transpose(glm::inverse(glm::mat3(_modelMat)));
+}
 
-    glUniform3fv(glGetUniformLocation(program, "lightPos"), 1, &studioEnv.LightPos.x);
-    glUniform3fv(glGetUniformLocation(program, "lightAmbient"), 1, &studioEnv.LightAmbient.x);
-    glUniform3fv(glGetUniformLocation(program, "lightDiffuse"), 1, &studioEnv.LightDiffuse.x);
-    glUniform3fv(glGetUniformLocation(program, "lightSpecular"), 1, &studioEnv.LightSpecular.x);
+void PlanetObject::updateInstanceBounds()
+{
+    /// GPU culling only needs the bound of the whole field
+    _instanceBounds.resize(_pCullShader ? 0 : _amount);
 
-    /// Point light
-    for(int i = 0; i < NUM_POINT_LIGHTS; i++)
+    glm::vec3 minPos(0.f), maxPos(0.f);
+    for(GLuint i = 0; i < _amount; i++)
     {
-        string str("pointLights[");
-        str += (char)('0' + i);
-        str += "].position";
-        glUniform3fv(glGetUniformLocation(program, str.c_str()), 1, &studioEnv.PointLightPos[i].x);
+        glm::vec3 center;
+        GLfloat radius;
+        transformBoundingSphere(_modelMat * _modelMatrices[i], center, radius);
+        if(!_pCullShader)
+            _instanceBounds[i] = glm::vec4(center, radius);
+
+        minPos = (i == 0) ? center - radius : glm::min(minPos, center - radius);
+        maxPos = (i == 0) ? center + radius : glm::max(maxPos, center + radius);
     }
 
-    _curPos.y = _T[3][0]; _curPos.y = _T[3][1]; _curPos.z = _T[3][2];
+    /// The whole field is rejected at once when it is out of view
+    glm::vec3 fieldCenter = (minPos + maxPos) * 0.5f;
+    _fieldBound = glm::vec4(fieldCenter, glm::length(maxPos - fieldCenter));
+    _boundsModelMat = _modelMat;
+}
 
-    /// viewer
-    glUniform3fv(glGetUniformLocation(program, "viewPos"), 1, &studioEnv.ViewPos.x);
+bool PlanetObject::CullByFrustum(const Frustum& frustum)
+{
+    /// Asteroids do not move by themselves, so bounds are rebuilt only when the field moves
+    if(_fieldBound.w == 0.f || _boundsModelMat != _modelMat)
+        updateInstanceBounds();
 
-    glm::mat4 R(1.0f);
-    _modelMat = _T* R *_S;
-    glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(_modelMat)));
+    _isFieldVisible = frustum.IsSphereVisible(glm::vec3(_fieldBound), _fieldBound.w);
+
+    /// Each asteroid is tested by the compute shader at draw time
+    if(_pCullShader)
+    {
+        _frustum = frustum;
+        return _isFieldVisible;
+    }
+
+    _visibleInstances.clear();
+
+    if(!_isFieldVisible)
+        return false;
+
+    for(GLuint i = 0; i < _amount; i++)
+    {
+        const glm::vec4& bound = _instanceBounds[i];
+        if(frustum.IsSphereVisible(glm::vec3(bound), bound.w))
+            _visibleInstances.push_back(i);
+    }
+
+    return !_visibleInstances.empty();
+}
+
+void PlanetObject::uploadVisibleMatrices(StudioEnv& studioEnv)
+{
+    _lodInstanceCounts.assign(_lods.size(), 0);
+    _instanceLods.resize(_visibleInstances.size());
+    for(GLuint i = 0; i < _visibleInstances.size(); i++)
+    {
+        const glm::vec4& bound = _instanceBounds[_visibleInstances[i]];
+        _instanceLods[i] = selectLod(glm::vec3(bound), bound.w, studioEnv);
+        _lodInstanceCounts[_instanceLods[i]]++;
+    }
 
-    glUniformMatrix4fv(glGetUniformLocation(program, "PV"), 1, GL_FALSE,  &PV[0][0]);
-    glUniformMatrix4fv(glGetUniformLocation(program, "M"), 1, GL_FALSE,  &_modelMat[0][0]);
-    glUniformMatrix3fv(glGetUniformLocation(program, "normalMat"), 1, GL_FALSE,  &normalMat[0][0]);
+    /// Counting sort keeps asteroids of a level next to each other, so each level is one instanced draw
+    vector<GLuint> slots(_lods.size(), 0);
+    for(GLuint i = 1; i < _lods.size(); i++)
+        slots[i] = slots[i - 1] + _lodInstanceCounts[i - 1];
+
+    _visibleMatrices.resize(_visibleInstances.size());
+    for(GLuint i = 0; i < _visibleInstances.size(); i++)
+        _visibleMatrices[slots[_instanceLods[i]]++] = _modelMatrices[_visibleInstances[i]];
+
+    /// Orphan the previous storage and upload only visible asteroids
+    GLsizeiptr size = _visibleMatrices.size() * sizeof(glm::mat4);
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, size, &_visibleMatrices[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void PlanetObject::cullOnGpu(StudioEnv& studioEnv)
+{
+    /// Restart counting visible asteroids of each level
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, _lodCommands.size() * sizeof(DrawElementsIndirectCommand), &_lodCommands[0]);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    _pCullShader->Use();
+    _cullMLoc.Set(_modelMat);
+    _cullBoundLoc.Set(glm::vec4(_boundCenter, _boundRadius));
+    _cullCountLoc.Set((GLint)_amount);
+    for(GLuint i = 0; i < Frustum::NUM_PLANES; i++)
+        _cullPlaneLocs[i].Set(_frustum.Planes[i]);
+
+    /// Same selection as "selectLod". The view and the projection come from StudioEnvBlock.
+    _cullLodCountLoc.Set((GLint)_lodCommands.size());
+    for(GLuint i = 0; i < _lodCommands.size(); i++)
+        _cullLodErrorLocs[i].Set(_lods[i].Error / MESH_LOD_PIXEL_ERROR);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, _matrixSsbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, _instanceVbo);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, _indirectBuffer);
+
+    glDispatchCompute((_amount + CULL_WORK_GROUP_SIZE - 1) / CULL_WORK_GROUP_SIZE, 1, 1);
+
+    /// The draw reads the command and the instance buffer written above,
+    /// and the next frame resets the commands by glBufferSubData
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+}
+
+bool PlanetObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+{
+    if(_pCullShader)
+    {
+        if(!_isFieldVisible)
+            return true;
+
+        cullOnGpu(studioEnv);
+    }
+    else
+    {
+        if(_visibleInstances.empty())
+            return true;
+
+        uploadVisibleMatrices(studioEnv);
+    }
+
+    if(SetTextureToShader() == false)
+        return false;
+
+    _PVLoc.Set(PV);
+    _MLoc.Set(_modelMat);
+    _normalMatLoc.Set(_normalMat);
+    _posOffsetLoc.Set(_posOffset);
+    _posScaleLoc.Set(_posScale);
 
     DrawContainer();
 
@@ -180,7 +364,29 @@ void PlanetObject::DrawContainer()
 {
     /// Draw mesh
     glBindVertexArray(_vao);
-    glDrawElementsInstanced(GL_TRIANGLES, _indices.size(), GL_UNSIGNED_INT, 0, _amount);
+    if(_pCullShader)
+    {
+        /// Instance counts of all levels come from the compute shader
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _indirectBuffer);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, _indexType, 0, _lodCommands.size(), 0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    else
+    {
+        /// One instanced draw per level, reading its part of the instance buffer
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+        GLuint firstInstance = 0;
+        for(GLuint i = 0; i < _lods.size(); i++)
+        {
+            if(_lodInstanceCounts[i] == 0)
+                continue;
+
+            setInstanceAttribute(firstInstance);
+            glDrawElementsInstanced(GL_TRIANGLES, _lods[i].IndexCount, _indexType, getLodOffset(i), _lodInstanceCounts[i]);
+            firstInstance += _lodInstanceCounts[i];
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     glBindVertexArray(0);
 
     for (GLuint i = 0; i < _textures.size(); i++)
@@ -39,6 +39,12 @@ RectObject::RectObject(Shader* pShader, glm::vec3 objectColor) : TriangleObject(
 RectObject::~RectObject() {
 }
 
+void RectObject::GetUniformLocations()
+{
+    TriangleObject::GetUniformLocations();
+    _objColorLoc = _pShader->GetUniform("objColor");
+}
+
 bool RectObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
 {
     if(SetTextureToShader() == false)
@@ -53,8 +59,8 @@ bool RectObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studi
 
     glm::vec4 objColor(_objectColor, 0.3f);
 
-    glUniformMatrix4fv(glGetUniformLocation (_pShader->GetProgram(), "PVM"), 1, GL_FALSE,  &PVM[0][0]);
-    glUniform4fv(glGetUniformLocation (_pShader->GetProgram(), "objColor"), 1,  &objColor.x);
+    _PVMLoc.Set(PVM);
+    _objColorLoc.Set(objColor);
 
     DrawContainer();
 
@@ -0,0 +1,243 @@
+#include <float.h>
+#include <algorithm>
+#include "sceneBvh.h"
+#include "rayIntersect.h"
+
+#define BVH_LEAF_SIZE       4       /// The maximum number of items in a leaf
+#define BVH_MAX_DEPTH       64      /// Size of the traversal stack
+#define BVH_REBUILD_RATIO   2.0f    /// Rebuild when refitted nodes grow over this ratio
+
+namespace gl
+{
+
+static float SurfaceArea(const glm::vec3& boxMin, const glm::vec3& boxMax)
+{
+    glm::vec3 d = boxMax - boxMin;
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+SceneBvh::SceneBvh() : _builtArea(0.f), _numInstances(0)
+{
+}
+
+void SceneBvh::collectItems(const vector<IGraphicObject*>& objs)
+{
+    _items.clear();
+
+    for(uint32_t i = 0; i < objs.size(); i++)
+    {
+        IGraphicObject* pObj = objs[i];
+        for(uint32_t j = 0; j < pObj->GetInstanceCount(); j++)
+        {
+            glm::vec3 center;
+            float radius;
+            if(!pObj->GetInstanceBound(j, center, radius))
+                continue;
+
+            SceneBvhItem item;
+            item.Obj = pObj;
+            item.Index = j;
+            item.Center = center;
+            item.Min = center - radius;
+            item.Max = center + radius;
+            _items.push_back(item);
+        }
+    }
+}
+
+void SceneBvh::build()
+{
+    _nodes.clear();
+    if(_items.empty())
+        return;
+
+    _nodes.reserve(2 * _items.size() / BVH_LEAF_SIZE + 1);
+    buildNode(0, _items.size());
+
+    _builtArea = 0.f;
+    for(uint32_t i = 0; i < _nodes.size(); i++)
+        _builtArea += SurfaceArea(_nodes[i].Min, _nodes[i].Max);
+}
+
+uint32_t SceneBvh::buildNode(uint32_t first, uint32_t count)
+{
+    uint32_t nodeIndex = _nodes.size();
+    _nodes.push_back(SceneBvhNode());
+
+    glm::vec3 boxMin = _items[first].Min, boxMax = _items[first].Max;
+    glm::vec3 centerMin = _items[first].Center, centerMax = _items[first].Center;
+    for(uint32_t i = first + 1; i < first + count; i++)
+    {
+        boxMin = glm::min(boxMin, _items[i].Min);
+        boxMax = glm::max(boxMax, _items[i].Max);
+        centerMin = glm::min(centerMin, _items[i].Center);
+        centerMax = glm::max(centerMax, _items[i].Center);
+    }
+
+    _nodes[nodeIndex].Min = boxMin;
+    _nodes[nodeIndex].Max = boxMax;
+
+    if(count <= BVH_LEAF_SIZE)
+    {
+        _nodes[nodeIndex].First = first;
+        _nodes[nodeIndex].Count = count;
+        return nodeIndex;
+    }
+
+    /// Median split on the longest axis of item centers
+    glm::vec3 extent = centerMax - centerMin;
+    int axis = (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+    uint32_t half = count / 2;
+
+    std::nth_element(_items.begin() + first, _items.begin() + first + half, _items.begin() + first + count,
+                     [axis](const SceneBvhItem& a, const SceneBvhItem& b) { return a.Center[axis] < b.Center[axis]; });
+
+    /// The first child always follows its parent
+    buildNode(first, half);
+    uint32_t right = buildNode(first + half, count - half);
+
+    _nodes[nodeIndex].First = right;
+    _nodes[nodeIndex].Count = 0;
+
+    return nodeIndex;
+}
+
+float SceneBvh::refit()
+{
+    float area = 0.f;
+
+    /// Children are stored after their parent, so going backward visits children first
+    for(int32_t i = (int32_t)_nodes.size() - 1; i >= 0; i--)
+    {
+        SceneBvhNode& node = _nodes[i];
+        if(node.Count > 0)
+        {
+            node.Min = _items[node.First].Min;
+            node.Max = _items[node.First].Max;
+            for(uint32_t j = node.First + 1; j < node.First + node.Count; j++)
+            {
+                node.Min = glm::min(node.Min, _items[j].Min);
+                node.Max = glm::max(node.Max, _items[j].Max);
+            }
+        }
+        else
+        {
+            const SceneBvhNode& left = _nodes[i + 1];
+            const SceneBvhNode& right = _nodes[node.First];
+            node.Min = glm::min(left.Min, right.Min);
+            node.Max = glm::max(left.Max, right.Max);
+        }
+
+        area += SurfaceArea(node.Min, node.Max);
+    }
+
+    return area;
+}
+
+void SceneBvh::Update(const vector<IGraphicObject*>& objs)
+{
+    uint32_t numInstances = 0;
+    for(uint32_t i = 0; i < objs.size(); i++)
+        numInstances += objs[i]->GetInstanceCount();
+
+    /// Objects or instances were added or removed.
+    /// Whether an instance is pickable does not change, so counting instances is enough.
+    bool isChanged = _nodes.empty() || (numInstances != _numInstances);
+
+    /// Refresh bounds of the items in the tree order
+    for(uint32_t i = 0; i < _items.size() && !isChanged; i++)
+    {
+        SceneBvhItem& item = _items[i];
+        glm::vec3 center;
+        float radius;
+
+        if(item.Index >= item.Obj->GetInstanceCount() || !item.Obj->GetInstanceBound(item.Index, center, radius))
+        {
+            isChanged = true;
+            break;
+        }
+
+        item.Center = center;
+        item.Min = center - radius;
+        item.Max = center + radius;
+    }
+
+    if(isChanged)
+    {
+        _numInstances = numInstances;
+        collectItems(objs);
+        build();
+        return;
+    }
+
+    /// Moving instances loosen the tree. Rebuild when it gets much worse than a fresh build.
+    if(refit() > _builtArea * BVH_REBUILD_RATIO)
+    {
+        collectItems(objs);
+        build();
+    }
+}
+
+bool SceneBvh::Cast(glm::vec3 org, glm::vec3 dir, SceneBvhHit& hit)
+{
+    if(_nodes.empty())
+        return false;
+
+    glm::vec3 invDir = 1.f / dir;
+    float closest = FLT_MAX;
+    bool isHit = false;
+
+    uint32_t stack[BVH_MAX_DEPTH];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while(stackSize > 0)
+    {
+        const SceneBvhNode& node = _nodes[stack[--stackSize]];
+
+        float entry;
+        if(!IntersectRayAabb(org, invDir, node.Min, node.Max, closest, entry))
+            continue;
+
+        if(node.Count > 0)
+        {
+            for(uint32_t i = node.First; i < node.First + node.Count; i++)
+            {
+                float distance;
+                SceneBvhItem& item = _items[i];
+                if(item.Obj->IsInstanceIntersected(item.Index, org, dir, &distance) && distance < closest)
+                {
+                    closest = distance;
+                    hit.Obj = item.Obj;
+                    hit.Index = item.Index;
+                    hit.Distance = distance;
+                    isHit = true;
+                }
+            }
+            continue;
+        }
+
+        /// Visit the nearer child first, so farther subtrees are pruned by the closest hit
+        uint32_t left = (uint32_t)(&node - &_nodes[0]) + 1;
+        uint32_t right = node.First;
+        float leftEntry, rightEntry;
+        bool isLeftHit = IntersectRayAabb(org, invDir, _nodes[left].Min, _nodes[left].Max, closest, leftEntry);
+        bool isRightHit = IntersectRayAabb(org, invDir, _nodes[right].Min, _nodes[right].Max, closest, rightEntry);
+
+        if(isLeftHit && isRightHit)
+        {
+            if(leftEntry < rightEntry)
+                std::swap(left, right);
+            stack[stackSize++] = left;
+            stack[stackSize++] = right;
+        }
+        else if(isLeftHit)
+            stack[stackSize++] = left;
+        else if(isRightHit)
+            stack[stackSize++] = right;
+    }
+
+    return isHit;
+}
+
+}   /// namespace gl
@@ -1,6 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#include <vector>
 #include "shader.h"
+#include "studioEnv.h"
 #include "logging.h"
 
 namespace gl
@@ -79,32 +82,40 @@ static bool ReadShaderCodeFile( const char *fileName, string &shaderCode)
 }
 
 /**
- * @brief   Compile shader object
- *          If there is any error while compiling,
- *          the error information will be written in the log file.
+ * @brief   Start compiling a shader object
+ *          The result is not waited for here, so that the driver can compile
+ *          several shaders at once. Check it with "IsShaderCompiled" later.
  *
- * @param shaderObject      Shader object
  * @param shaderType        Shader type
- * @param shaderPath        Shader file path
- * @return                  The result of the compilation
+ * @param shaderCode        Shader source code
+ * @return                  Shader object
  */
-static bool CompileShaderObject(GLuint& shaderObject, GLenum shaderType, const GLchar* shaderPath)
+static GLuint SubmitShaderObject(GLenum shaderType, const string& shaderCode)
 {
-    string  shaderCode;      /// Shader buffer containing all code
-
-    if(!ReadShaderCodeFile(shaderPath, shaderCode))
-        return false;
-
-    /** Create fragment shader object and compile */
-    shaderObject = glCreateShader( shaderType );
+    /** Create shader object and compile */
+    GLuint shaderObject = glCreateShader( shaderType );
 
-    GLint params;
     const GLchar* t = (const GLchar *)shaderCode.c_str();
     /// Replaces the source code in a shader object
 	glShaderSource( shaderObject, 1, &t, NULL );
 	/// compiles a shader object
 	glCompileShader( shaderObject );
 
+    return shaderObject;
+}
+
+/**
+ * @brief   Check the compile result of a shader object
+ *          If there is any error while compiling,
+ *          the error information will be written in the log file.
+ *
+ * @param shaderObject      Shader object
+ * @return                  The result of the compilation
+ */
+static bool IsShaderCompiled(GLuint shaderObject)
+{
+    GLint params;
+
 	/** check for shader compile errors */
 	glGetShaderiv( shaderObject, GL_COMPILE_STATUS, &params );
 	if ( GL_TRUE != params ) {
@@ -117,32 +128,17 @@ static bool CompileShaderObject(GLuint& shaderObject, GLenum shaderType, const G
 }
 
 /**
- * @brief   Link shader programs
+ * @brief   Check the link result of a program object
  *          If there is any error while linking,
  *          the error information will be written in the log file.
  *
  * @param program           Program object
- * @param fragmentShader    Fragment Shader object to be linked
- * @param vertexShader      Vertex Shader object to be linked
- * @param tcsShader         Tessellation Control Shader object to be linked
- * @param tesShader         Tessellation Evaluation Shader object to be linked
- * @param gsShader          Geometry Shader object to be linked
  * @return                  The result of link
  */
-static bool LinkShaderPrograms(GLuint program, GLuint fragmentShader, GLuint vertexShader,
-                               GLuint tcsShader, GLuint tesShader, GLuint gsShader)
+static bool IsProgramLinked(GLuint program)
 {
     GLint params;
 
-   	if(vertexShader)    glAttachShader( program, vertexShader );
-	if(tcsShader)       glAttachShader( program, tcsShader );
-	if(tesShader)       glAttachShader( program, tesShader );
-	if(gsShader)        glAttachShader( program, gsShader );
-	if(fragmentShader)  glAttachShader( program, fragmentShader );
-
-    /// Links a program object
-	glLinkProgram(program);
-
 	/** check for shader linking errors */
 	glGetProgramiv( program, GL_LINK_STATUS, &params );
 	if ( GL_TRUE != params ) {
@@ -154,73 +150,335 @@ static bool LinkShaderPrograms(GLuint program, GLuint fragmentShader, GLuint ver
     return true;
 }
 
-bool Shader::Initialize()
+/**
+ * @brief   Check program binaries can be retrieved and loaded
+ *          Some drivers support the API without any binary format.
+ *
+ * @return  true if program binaries are supported
+ */
+static bool IsProgramBinarySupported()
+{
+    if(!GLEW_VERSION_4_1 && !GLEW_ARB_get_program_binary)
+        return false;
+
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return numFormats > 0;
+}
+
+/**
+ * @brief   Add a string into FNV-1a hash
+ *
+ * @param hash      hash to update
+ * @param str       string to add. The terminating null is added too, so that strings are separated.
+ */
+static void HashString(uint64_t& hash, const char* str)
 {
-    GLuint  vertexShader = 0;       /// Vertex shader object
-    GLuint  fragmentShader = 0;     /// Fragment shader object
-    GLuint  tcsShader = 0;          /// Tessellation Control shader object
-    GLuint  tesShader = 0;          /// Tessellation Evaluation shader object
-    GLuint  gsShader = 0;           /// Geometry shader object
+    do {
+        hash ^= (unsigned char)*str;
+        hash *= 1099511628211ULL;
+    } while(*str++);
+}
 
-    /** Create vertex shader object and compile */
-    if(!CompileShaderObject(vertexShader, GL_VERTEX_SHADER, _vertexPath))
-    {
-        LogError("Compile a vertex shader object fail \n");
+/**
+ * @brief   Make the cache file path of a program
+ *
+ * @param key       cache key
+ * @return  file path
+ */
+static string ShaderCachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx", (unsigned long long)key);
+    return string(SHADER_CACHE_DIR) + name + SHADER_CACHE_EXT;
+}
+
+bool Shader::loadProgramBinary(uint64_t key)
+{
+    FILE* file = fopen(ShaderCachePath(key).c_str(), "rb");
+    if(!file)
         return false;
-    }
 
-    /** Create fragment shader object and compile */
-    if(!CompileShaderObject(fragmentShader, GL_FRAGMENT_SHADER, _fragmentPath))
+    ShaderCacheHeader header;
+    vector<char> binary;
+    bool result = fread(&header, sizeof(header), 1, file) == 1
+                  && header.Magic == SHADER_CACHE_MAGIC && header.Version == SHADER_CACHE_VERSION
+                  && header.Key == key && header.Length > 0;
+    if(result)
     {
-        LogError("Compile a fragment shader object fail \n");
-        return false;
+        binary.resize(header.Length);
+        result = fread(&binary[0], 1, header.Length, file) == header.Length;
     }
+    fclose(file);
 
-    /** Create Tessellation Control shader object and compile */
-    if(_tcsPath != nullptr) /// optional shader
-    if(!CompileShaderObject(tcsShader, GL_TESS_CONTROL_SHADER, _tcsPath))
-    {
-        LogError("Compile a Tessellation Control shader object fail \n");
+    if(!result)
         return false;
+
+    /// Whether the driver accepts the binary is checked by "Finish"
+    glProgramBinary(_program, header.Format, &binary[0], header.Length);
+    return true;
+}
+
+void Shader::saveProgramBinary(uint64_t key)
+{
+    GLint length = 0;
+    glGetProgramiv(_program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if(length <= 0)
+        return;
+
+    ShaderCacheHeader header;
+    vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(_program, length, NULL, &format, &binary[0]);
+
+    header.Magic = SHADER_CACHE_MAGIC;
+    header.Version = SHADER_CACHE_VERSION;
+    header.Key = key;
+    header.Format = format;
+    header.Length = length;
+
+    mkdir(SHADER_CACHE_DIR, 0755);
+
+    string cachePath = ShaderCachePath(key);
+    string tempPath = cachePath + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if(!file)
+        return;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(&binary[0], 1, length, file) == (size_t)length;
+
+    if(fclose(file) != 0)
+        result = false;
+
+    /// Readers never see a partially written cache
+    if(!result || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+        remove(tempPath.c_str());
+}
+
+void Shader::submitStages()
+{
+    static const GLenum types[SHADER_NUM_STAGES] = {
+        GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_TESS_CONTROL_SHADER, GL_TESS_EVALUATION_SHADER, GL_GEOMETRY_SHADER
+    };
+
+    for(GLuint i = 0; i < SHADER_NUM_STAGES; i++)
+    {
+        if(_sources[i].empty())
+            continue;
+
+        /// A compute program has only the compute stage in the first slot
+        GLenum type = (i == 0 && _csPath != nullptr) ? GL_COMPUTE_SHADER : types[i];
+        _stages[i] = SubmitShaderObject(type, _sources[i]);
+        glAttachShader(_program, _stages[i]);
     }
 
-    /** Create Tessellation Evaluation shader object and compile */
-    if(_tesPath != nullptr) /// optional shader
-    if(!CompileShaderObject(tesShader, GL_TESS_EVALUATION_SHADER, _tesPath))
+    /// The binary of a linked program can be retrieved only when requested before linking
+    if(_isBinarySupported)
+        glProgramParameteri(_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    /// Links a program object
+    glLinkProgram(_program);
+}
+
+void Shader::releaseStages()
+{
+    /// Delete the shaders as they're linked into our program now and no longer necessery
+    for(GLuint i = 0; i < SHADER_NUM_STAGES; i++)
     {
-        LogError("Compile a Tessellation Evaluation shader object fail \n");
-        return false;
+        if(_stages[i])
+            glDeleteShader(_stages[i]);
+        _stages[i] = 0;
+        _sources[i].clear();
     }
+}
 
-    /** Create Geometry shader object and compile */
-    if(_gsPath != nullptr) /// optional shader
-    if(!CompileShaderObject(gsShader, GL_GEOMETRY_SHADER, _gsPath))
+bool Shader::Submit()
+{
+    if(_state != Shader_Created)
+        return _state != Shader_Failed;
+
+    /// Stages in the order of "submitStages". A compute program has only the compute stage.
+    const GLchar* paths[SHADER_NUM_STAGES] = { _csPath ? _csPath : _vertexPath, _fragmentPath, _tcsPath, _tesPath, _gsPath };
+    for(GLuint i = 0; i < SHADER_NUM_STAGES; i++)
     {
-        LogError("Compile a Geometry shader object fail \n");
-        return false;
+        if(paths[i] != nullptr && !ReadShaderCodeFile(paths[i], _sources[i]))
+        {
+            _state = Shader_Failed;
+            return false;
+        }
     }
 
     _program = glCreateProgram();
-	if(!LinkShaderPrograms(_program, fragmentShader, vertexShader, tcsShader, tesShader, gsShader))
+
+    /// Cache key from all sources and the driver, since a binary is valid only for the driver which made it
+    _isBinarySupported = IsProgramBinarySupported();
+    _cacheKey = 14695981039346656037ULL;
+    if(_isBinarySupported)
     {
-        LogError("Linking error ! \n");
+        HashString(_cacheKey, (const char*)glGetString(GL_VENDOR));
+        HashString(_cacheKey, (const char*)glGetString(GL_RENDERER));
+        HashString(_cacheKey, (const char*)glGetString(GL_VERSION));
+        HashString(_cacheKey, _csPath ? "compute" : "graphics");
+        for(GLuint i = 0; i < SHADER_NUM_STAGES; i++)
+            HashString(_cacheKey, _sources[i].c_str());
+    }
+
+    _isCached = _isBinarySupported && loadProgramBinary(_cacheKey);
+    if(!_isCached)
+        submitStages();
+
+    _state = Shader_Submitted;
+    return true;
+}
+
+bool Shader::IsCompleted()
+{
+    if(_state != Shader_Submitted || !GLEW_ARB_parallel_shader_compile)
+        return true;
+
+    GLint params = GL_TRUE;
+    glGetProgramiv(_program, GL_COMPLETION_STATUS_ARB, &params);
+    return params == GL_TRUE;
+}
+
+bool Shader::Finish()
+{
+    if(_state == Shader_Created && !Submit())
         return false;
+
+    if(_state != Shader_Submitted)
+        return _state == Shader_Ready;
+
+    /// A driver update can reject an old binary even if the version strings are the same
+    if(_isCached)
+    {
+        GLint params = GL_FALSE;
+        glGetProgramiv(_program, GL_LINK_STATUS, &params);
+        if(params == GL_TRUE)
+            Log("program %i is loaded from the binary cache \n", _program);
+        else
+        {
+            Log("program binary %016llx is stale \n", (unsigned long long)_cacheKey);
+            _isCached = false;
+            submitStages();
+        }
     }
 
-    if(!IsValidShaderProgram(_program))
+    bool result = true;
+    if(!_isCached)
+    {
+        static const char* names[SHADER_NUM_STAGES] = {
+            "vertex", "fragment", "Tessellation Control", "Tessellation Evaluation", "Geometry"
+        };
+
+        for(GLuint i = 0; i < SHADER_NUM_STAGES && result; i++)
+        {
+            if(_stages[i] && !IsShaderCompiled(_stages[i]))
+            {
+                LogError("Compile a %s shader object fail (%s) \n",
+                         (i == 0 && _csPath != nullptr) ? "compute" : names[i], _csPath ? _csPath : _vertexPath);
+                result = false;
+            }
+        }
+
+        if(result && !IsProgramLinked(_program))
+        {
+            LogError("Linking error ! \n");
+            result = false;
+        }
+    }
+
+    if(result && !IsValidShaderProgram(_program))
     {
         LogError("This is not valid program \n");
+        result = false;
+    }
+
+    if(!result)
+    {
+        releaseStages();
+        _state = Shader_Failed;
         return false;
     }
-    /// Delete the shaders as they're linked into our program now and no longer necessery
-    if(vertexShader) glDeleteShader(vertexShader);
-    if(fragmentShader) glDeleteShader(fragmentShader);
-    if(tcsShader) glDeleteShader(tcsShader);
-    if(tesShader) glDeleteShader(tesShader);
-    if(gsShader) glDeleteShader(gsShader);
 
+    buildUniformTable();
+
+    /// Connect the shared studio environment block to its fixed binding point
+    GLuint envBlock = glGetUniformBlockIndex(_program, STUDIO_ENV_BLOCK);
+    if(envBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(_program, envBlock, STUDIO_ENV_BINDING);
+
+    if(_isBinarySupported && !_isCached)
+        saveProgramBinary(_cacheKey);
+
+    releaseStages();
+    _state = Shader_Ready;
     return true;
 }
 
+bool Shader::Initialize()
+{
+    return Submit() && Finish();
+}
+
+void Shader::buildUniformTable()
+{
+    GLint count = 0;
+    GLint maxLength = 0;
+    _uniforms.clear();
+
+    glGetProgramiv(_program, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(_program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+    string name(maxLength + 1, '\0');
+
+    for(GLint i = 0; i < count; i++)
+    {
+        GLsizei length = 0;
+        GLint   size = 0;
+        GLenum  type;
+
+        glGetActiveUniform(_program, i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+
+        string uniformName(name.c_str(), length);
+        GLint loc = glGetUniformLocation(_program, uniformName.c_str());
+        /// Uniforms in a uniform block do not have a location
+        if(loc < 0)
+            continue;
+
+        /// Arrays of basic types are reported once as "name[0]".
+        /// Register the base name and all elements so that "name[i]" can be looked up.
+        if(uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+        {
+            string baseName = uniformName.substr(0, uniformName.size() - 3);
+            _uniforms[baseName] = loc;
+            for(GLint j = 1; j < size; j++)
+            {
+                string elemName = baseName + "[" + to_string(j) + "]";
+                _uniforms[elemName] = glGetUniformLocation(_program, elemName.c_str());
+            }
+        }
+
+        _uniforms[uniformName] = loc;
+    }
+
+    Log("program %i has %i active uniforms \n", _program, (int)_uniforms.size());
+}
+
+Uniform Shader::GetUniform(const string& name)
+{
+    Uniform uniform;
+
+    /// The uniform table is built when the link result is known
+    if(_state != Shader_Ready)
+        Finish();
+
+    map<string, GLint>::const_iterator it = _uniforms.find(name);
+    if(it != _uniforms.end())
+        uniform.Loc = it->second;
+
+    return uniform;
+}
 
 } /// namespace gl
@@ -0,0 +1,266 @@
+#include <math.h>
+#include <algorithm>
+#include "spatialHash.h"
+
+namespace gl
+{
+
+SpatialHash::SpatialHash(float cellSize) : _cellSize(cellSize), _stamp(0)
+{
+    _buckets.resize(SPATIAL_HASH_NUM_BUCKETS);
+}
+
+glm::ivec3 SpatialHash::cellOf(glm::vec3 pos) const
+{
+    return glm::ivec3(glm::floor(pos / _cellSize));
+}
+
+uint32_t SpatialHash::bucketOf(int32_t x, int32_t y, int32_t z) const
+{
+    /// Large primes from "Optimized Spatial Hashing for Collision Detection of Deformable Objects"
+    uint32_t hash = ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u);
+    return hash & (SPATIAL_HASH_NUM_BUCKETS - 1);
+}
+
+void SpatialHash::Clear()
+{
+    for(uint32_t i = 0; i < _buckets.size(); i++)
+        _buckets[i].clear();
+
+    _largeProxies.clear();
+    _proxies.clear();
+    _ranges.clear();
+}
+
+void SpatialHash::rebuild(const vector<IGraphicObject*>& objs)
+{
+    Clear();
+
+    for(uint32_t i = 0; i < objs.size(); i++)
+    {
+        IGraphicObject* pObj = objs[i];
+        struct ObjectInfo objInfo;
+        pObj->GetCurObjectInfo(objInfo);
+
+        ObjectRange range;
+        range.Obj = pObj;
+        range.Mask = SPATIAL_MASK(objInfo.ObjType);
+        range.First = _proxies.size();
+        range.Count = pObj->GetInstanceCount();
+        range.IsStatic = pObj->IsStatic();
+        _ranges.push_back(range);
+
+        for(uint32_t j = 0; j < range.Count; j++)
+        {
+            pObj->GetInstanceInfo(j, objInfo);
+
+            SpatialHashProxy proxy;
+            proxy.Obj = pObj;
+            proxy.Index = j;
+            proxy.Mask = SPATIAL_MASK(objInfo.ObjType);
+            proxy.Center = objInfo.CurPos;
+            proxy.Radius = objInfo.ObjRadius;
+            proxy.CellMin = cellOf(proxy.Center - proxy.Radius);
+            proxy.CellMax = cellOf(proxy.Center + proxy.Radius);
+            proxy.Stamp = 0;
+
+            glm::ivec3 span = proxy.CellMax - proxy.CellMin + 1;
+            proxy.IsLarge = (span.x * span.y * span.z > SPATIAL_HASH_MAX_CELLS);
+
+            _proxies.push_back(proxy);
+            insert(_proxies.size() - 1);
+        }
+    }
+}
+
+void SpatialHash::insert(uint32_t proxyIndex)
+{
+    const SpatialHashProxy& proxy = _proxies[proxyIndex];
+    if(proxy.IsLarge)
+    {
+        _largeProxies.push_back(proxyIndex);
+        return;
+    }
+
+    for(int32_t z = proxy.CellMin.z; z <= proxy.CellMax.z; z++)
+        for(int32_t y = proxy.CellMin.y; y <= proxy.CellMax.y; y++)
+            for(int32_t x = proxy.CellMin.x; x <= proxy.CellMax.x; x++)
+                _buckets[bucketOf(x, y, z)].push_back(proxyIndex);
+}
+
+static void RemoveOne(vector<uint32_t>& list, uint32_t proxyIndex)
+{
+    vector<uint32_t>::iterator it = std::find(list.begin(), list.end(), proxyIndex);
+    if(it != list.end())
+    {
+        *it = list.back();
+        list.pop_back();
+    }
+}
+
+void SpatialHash::remove(uint32_t proxyIndex)
+{
+    const SpatialHashProxy& proxy = _proxies[proxyIndex];
+    if(proxy.IsLarge)
+    {
+        RemoveOne(_largeProxies, proxyIndex);
+        return;
+    }
+
+    /// One entry per covered cell, as many as "insert" added even when cells share a bucket
+    for(int32_t z = proxy.CellMin.z; z <= proxy.CellMax.z; z++)
+        for(int32_t y = proxy.CellMin.y; y <= proxy.CellMax.y; y++)
+            for(int32_t x = proxy.CellMin.x; x <= proxy.CellMax.x; x++)
+                RemoveOne(_buckets[bucketOf(x, y, z)], proxyIndex);
+}
+
+void SpatialHash::setBound(uint32_t proxyIndex, glm::vec3 center, float radius)
+{
+    SpatialHashProxy& proxy = _proxies[proxyIndex];
+    glm::ivec3 cellMin = cellOf(center - radius);
+    glm::ivec3 cellMax = cellOf(center + radius);
+
+    proxy.Center = center;
+    proxy.Radius = radius;
+
+    /// Most instances stay in the same cells between two updates
+    if(cellMin == proxy.CellMin && cellMax == proxy.CellMax)
+        return;
+
+    remove(proxyIndex);
+
+    glm::ivec3 span = cellMax - cellMin + 1;
+    proxy.CellMin = cellMin;
+    proxy.CellMax = cellMax;
+    proxy.IsLarge = (span.x * span.y * span.z > SPATIAL_HASH_MAX_CELLS);
+
+    insert(proxyIndex);
+}
+
+void SpatialHash::Update(const vector<IGraphicObject*>& objs)
+{
+    /// Objects or instances were added or removed
+    bool isChanged = (_ranges.size() != objs.size());
+    for(uint32_t i = 0; i < objs.size() && !isChanged; i++)
+        isChanged = (_ranges[i].Obj != objs[i]) || (_ranges[i].Count != objs[i]->GetInstanceCount());
+
+    if(isChanged)
+    {
+        rebuild(objs);
+        return;
+    }
+
+    for(uint32_t i = 0; i < _ranges.size(); i++)
+    {
+        const ObjectRange& range = _ranges[i];
+        if(range.IsStatic)
+            continue;
+
+        for(uint32_t j = 0; j < range.Count; j++)
+        {
+            struct ObjectInfo objInfo;
+            range.Obj->GetInstanceInfo(j, objInfo);
+            setBound(range.First + j, objInfo.CurPos, objInfo.ObjRadius);
+        }
+    }
+}
+
+void SpatialHash::gather(glm::vec3 center, float radius, uint32_t mask)
+{
+    _candidates.clear();
+
+    /// Stamps prevent testing a proxy twice when it covers several cells
+    if(++_stamp == 0)
+    {
+        for(uint32_t i = 0; i < _proxies.size(); i++)
+            _proxies[i].Stamp = 0;
+        _stamp = 1;
+    }
+
+    glm::ivec3 cellMin = cellOf(center - radius);
+    glm::ivec3 cellMax = cellOf(center + radius);
+    glm::ivec3 span = cellMax - cellMin + 1;
+
+    /// A query larger than the table visits every bucket anyway
+    if(span.x * span.y * span.z > SPATIAL_HASH_NUM_BUCKETS)
+    {
+        for(uint32_t i = 0; i < _proxies.size(); i++)
+            _candidates.push_back(i);
+    }
+    else
+    {
+        for(int32_t z = cellMin.z; z <= cellMax.z; z++)
+            for(int32_t y = cellMin.y; y <= cellMax.y; y++)
+                for(int32_t x = cellMin.x; x <= cellMax.x; x++)
+                {
+                    const vector<uint32_t>& bucket = _buckets[bucketOf(x, y, z)];
+                    _candidates.insert(_candidates.end(), bucket.begin(), bucket.end());
+                }
+        _candidates.insert(_candidates.end(), _largeProxies.begin(), _largeProxies.end());
+    }
+
+    /// Exact sphere test. Buckets also hold instances of other cells sharing the hash.
+    uint32_t numHits = 0;
+    for(uint32_t i = 0; i < _candidates.size(); i++)
+    {
+        SpatialHashProxy& proxy = _proxies[_candidates[i]];
+        if(proxy.Stamp == _stamp)
+            continue;
+        proxy.Stamp = _stamp;
+
+        if(!(proxy.Mask & mask))
+            continue;
+
+        glm::vec3 d = proxy.Center - center;
+        float r = proxy.Radius + radius;
+        if(glm::dot(d, d) <= r * r)
+            _candidates[numHits++] = _candidates[i];
+    }
+    _candidates.resize(numHits);
+}
+
+uint32_t SpatialHash::Query(glm::vec3 center, float radius, uint32_t mask, vector<const SpatialHashProxy*>& hits)
+{
+    gather(center, radius, mask);
+
+    for(uint32_t i = 0; i < _candidates.size(); i++)
+        hits.push_back(&_proxies[_candidates[i]]);
+
+    return _candidates.size();
+}
+
+uint32_t SpatialHash::QueryPairs(uint32_t maskA, uint32_t maskB, vector<SpatialHashPair>& pairs)
+{
+    uint32_t numPairs = 0;
+
+    for(uint32_t i = 0; i < _ranges.size(); i++)
+    {
+        const ObjectRange& range = _ranges[i];
+        if(!(range.Mask & maskA))
+            continue;
+
+        for(uint32_t a = range.First; a < range.First + range.Count; a++)
+        {
+            const SpatialHashProxy& proxyA = _proxies[a];
+            gather(proxyA.Center, proxyA.Radius, maskB);
+
+            for(uint32_t j = 0; j < _candidates.size(); j++)
+            {
+                uint32_t b = _candidates[j];
+                const SpatialHashProxy& proxyB = _proxies[b];
+
+                /// Both belong to both groups. Report the pair only from the lower index.
+                if(b == a || ((proxyB.Mask & maskA) && (proxyA.Mask & maskB) && b < a))
+                    continue;
+
+                SpatialHashPair pair = { &proxyA, &proxyB };
+                pairs.push_back(pair);
+                numPairs++;
+            }
+        }
+    }
+
+    return numPairs;
+}
+
+}   /// namespace gl
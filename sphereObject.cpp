@@ -1,5 +1,9 @@
 #include <cstdlib>
+#include <stddef.h>
+#include <string.h>
+#include <map>
 #include "sphereObject.h"
+#include "rayIntersect.h"
 #include "logging.h"
 
 /// Set up vertex data (and buffer(s)) and attribute pointers
@@ -47,124 +51,410 @@ static GLuint indices[] = {
     1, 6, 10
 };
 
+/// Edge length of the icosahedron above on the unit sphere
+#define ICOSAHEDRON_EDGE    1.0515f
+
 namespace gl
 {
 
 static int gSeedNum = 0;
 
+/// Renderers which run tessellation on CPU
+static const char* gSoftwareRenderers[] = {
+    "llvmpipe", "softpipe", "SwiftShader", "Software Rasterizer", "Microsoft Basic Render"
+};
+
+SphereRenderPath SphereObject::ChooseRenderPath(SphereRenderPath requested)
+{
+    SphereRenderPath path = requested;
+    const char* reason = "configuration";
+
+    const char* env = getenv(SPHERE_RENDER_ENV);
+    if(path == SphereRender_Auto && env)
+    {
+        if(strcmp(env, "tessellation") == 0)
+            path = SphereRender_Tessellation;
+        else if(strcmp(env, "icosphere") == 0)
+            path = SphereRender_Icosphere;
+        else
+            LogError("[SphereObject] unknown %s=%s \n", SPHERE_RENDER_ENV, env);
+        reason = SPHERE_RENDER_ENV;
+    }
+
+    /// Tessellation can not be used without support whatever is requested
+    if(!GLEW_VERSION_4_0 && !GLEW_ARB_tessellation_shader)
+    {
+        path = SphereRender_Icosphere;
+        reason = "no tessellation support";
+    }
+
+    if(path == SphereRender_Auto)
+    {
+        const char* renderer = (const char*)glGetString(GL_RENDERER);
+        path = SphereRender_Tessellation;
+        reason = "probe";
+
+        for(GLuint i = 0; renderer && i < sizeof(gSoftwareRenderers) / sizeof(gSoftwareRenderers[0]); i++)
+        {
+            if(strstr(renderer, gSoftwareRenderers[i]))
+            {
+                path = SphereRender_Icosphere;
+                reason = "software rasterizer";
+                break;
+            }
+        }
+    }
+
+    Log("[SphereObject] spheres are drawn by %s (%s) \n",
+        (path == SphereRender_Icosphere) ? "instanced icospheres" : "tessellation", reason);
+
+    return path;
+}
+
 void SphereObject::GetUniformLocations()
 {
-    /// The location of uniform variables related with light calculation
-    _lightPosLoc = glGetUniformLocation(_pShader->GetProgram(), "lightPos");
-    _viewPosLoc = glGetUniformLocation(_pShader->GetProgram(), "viewPos");
-    _lightColorLoc = glGetUniformLocation(_pShader->GetProgram(), "lightColor");
-    _objectColorLoc = glGetUniformLocation(_pShader->GetProgram(), "objectColor");
+    TriangleObject::GetUniformLocations();
 
-    /// The location of uniform variables related with PVM calculation
-    _PVLoc = glGetUniformLocation(_pShader->GetProgram(), "PV");
-    _MLoc = glGetUniformLocation(_pShader->GetProgram(), "M");
-    _normalMatLoc = glGetUniformLocation(_pShader->GetProgram(), "normalMat");
+    /// The location of uniform variables related with PV calculation
+    _PVLoc = _pShader->GetUniform("PV");
+
+    for(GLuint i = 0; i < Frustum::NUM_PLANES; i++)
+        _frustumPlaneLocs[i] = _pShader->GetUniform("frustumPlanes[" + to_string(i) + "]");
+    _tessPixelsLoc = _pShader->GetUniform("tessPixels");
+    _maxTessLevelLoc = _pShader->GetUniform("maxTessLevel");
 }
 
-SphereObject::SphereObject(Shader* pShader, const char* texturePath) : TriangleObject(pShader, texturePath)
+SphereObject::SphereObject(Shader* pShader, const char* texturePath, GLuint count) : TriangleObject(pShader, texturePath)
 {
     _vertices = vertices; _sizeVertices = sizeof(vertices);
     _indices = indices; _sizeIndices = sizeof(indices);
     _objType = Object_Sphere;
+    _count = count;
+    _instanceVbo = 0;
+    _drawCount = 0;
+    _hitIndex = -1;
+    _renderPath = SphereRender_Tessellation;
 }
 
-SphereObject::SphereObject(Shader* pShader, glm::vec3 objectColor) : TriangleObject(pShader, objectColor)
+SphereObject::SphereObject(Shader* pShader, glm::vec3 objectColor, GLuint count) : SphereObject(pShader, (const char*)nullptr, count)
 {
-    _vertices = vertices; _sizeVertices = sizeof(vertices);
-    _indices = indices; _sizeIndices = sizeof(indices);
-    _focusedTime = 0.f;
-    _startTime = 0.f;
-    _seedNum = gSeedNum++;
-    _objType = Object_Sphere;
+    _objectColor = objectColor;
 }
 
 SphereObject::~SphereObject() {
+    if(_instanceVbo)
+        glDeleteBuffers(1, &_instanceVbo);
 }
 
-bool SphereObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+void SphereObject::buildIcospheres()
 {
-    if(SetTextureToShader() == false)
+    /// Start from the icosahedron on the unit sphere, which is also the normal
+    vector<glm::vec3> positions;
+    for(GLuint i = 0; i < sizeof(vertices) / (5 * sizeof(GLfloat)); i++)
+        positions.push_back(glm::normalize(glm::vec3(vertices[i * 5], vertices[i * 5 + 1], vertices[i * 5 + 2])));
+
+    vector<GLuint> tris(indices, indices + sizeof(indices) / sizeof(GLuint));
+    vector<GLuint> nextTris;
+
+    /// Vertices at midpoints are shared by both triangles of the edge, and by all finer levels
+    map<pair<GLuint, GLuint>, GLuint> midpoints;
+    auto midpoint = [&positions, &midpoints](GLuint a, GLuint b)
+    {
+        pair<GLuint, GLuint> key(min(a, b), max(a, b));
+        map<pair<GLuint, GLuint>, GLuint>::iterator it = midpoints.find(key);
+        if(it != midpoints.end())
+            return it->second;
+
+        GLuint index = positions.size();
+        positions.push_back(glm::normalize(positions[a] + positions[b]));
+        midpoints[key] = index;
+        return index;
+    };
+
+    _icoIndices.clear();
+    for(GLuint level = 0; level < SPHERE_ICO_LEVELS; level++)
+    {
+        /// Each triangle is split into four, keeping its winding
+        nextTris.clear();
+        for(GLuint i = 0; i < tris.size(); i += 3)
+        {
+            GLuint a = tris[i], b = tris[i + 1], c = tris[i + 2];
+            GLuint ab = midpoint(a, b), bc = midpoint(b, c), ca = midpoint(c, a);
+            GLuint split[] = { a, ab, ca,  ab, b, bc,  ca, bc, c,  ab, bc, ca };
+            nextTris.insert(nextTris.end(), split, split + 12);
+        }
+        tris.swap(nextTris);
+
+        _icoFirstIndex[level] = _icoIndices.size();
+        _icoIndexCount[level] = tris.size();
+        _icoIndices.insert(_icoIndices.end(), tris.begin(), tris.end());
+    }
+
+    /// Texture coordinates are not used by this path
+    _icoVertices.assign(positions.size() * 5, 0.f);
+    for(GLuint i = 0; i < positions.size(); i++)
+    {
+        _icoVertices[i * 5] = positions[i].x;
+        _icoVertices[i * 5 + 1] = positions[i].y;
+        _icoVertices[i * 5 + 2] = positions[i].z;
+    }
+
+    _vertices = &_icoVertices[0]; _sizeVertices = _icoVertices.size() * sizeof(GLfloat);
+    _indices = &_icoIndices[0]; _sizeIndices = _icoIndices.size() * sizeof(GLuint);
+}
+
+bool SphereObject::Initialize()
+{
+    if(_renderPath == SphereRender_Icosphere)
+        buildIcospheres();
+
+    if(!TriangleObject::Initialize())
         return false;
 
-    GetUniformLocations();
+    /// GPU owns the icospheres from now on
+    if(_renderPath == SphereRender_Icosphere)
+    {
+        vector<GLfloat>().swap(_icoVertices);
+        vector<GLuint>().swap(_icoIndices);
+        _vertices = vertices; _sizeVertices = sizeof(vertices);
+        _indices = indices; _sizeIndices = sizeof(indices);
+    }
+
+    _orgPositions.assign(_count, glm::vec3(0.f));
+    _positions.assign(_count, glm::vec3(0.f));
+    _prevPositions.assign(_count, glm::vec3(0.f));
+    _movingDistances.assign(_count, glm::vec3(0.f));
+    _movements.assign(_count, glm::vec3(0.f));
+    _colors.assign(_count, _objectColor);
+    _focused.assign(_count, 0);
+    _visible.assign(_count, 1);
+    _focusedTimes.assign(_count, 0.);
+    _startTimes.assign(_count, 0.);
+    _seedNums.resize(_count);
+    for(GLuint i = 0; i < _count; i++)
+        _seedNums[i] = gSeedNum++;
+
+    _instances.resize(_count);
+
+    /// Per instance attributes
+    glGenBuffers(1, &_instanceVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, _count * sizeof(SphereInstance), NULL, GL_STREAM_DRAW);
+
+    glBindVertexArray(_vao);
+    setInstanceAttribute(0);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    return true;
+}
+
+void SphereObject::setInstanceAttribute(GLuint firstInstance)
+{
+    GLsizeiptr offset = firstInstance * sizeof(SphereInstance);
+
+    /// Position and scale attribute
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (GLvoid*)(offset + offsetof(SphereInstance, PosScale)));
+
+    /// Color attribute
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (GLvoid*)(offset + offsetof(SphereInstance, Color)));
+}
+
+void SphereObject::Update(const double dt, StudioEnv& studioEnv)
+{
+    _time += dt;
 
     if(_isFirstRendering == true) {
         Reset(studioEnv);
         _isFirstRendering = false;
     }
 
-    if(_lightPosLoc > -1) glUniform3fv(_lightPosLoc, 1, &studioEnv.LightPos.x);
-    if(_viewPosLoc > -1) glUniform3fv(_viewPosLoc, 1, &studioEnv.ViewPos.x);
-    if(_lightColorLoc > -1) glUniform3fv(_lightColorLoc, 1, &studioEnv.LightSpecular.x);
-    if(_objectColorLoc > -1) {
-            if(_isFocused)
-            {
-                glUniform3fv(_objectColorLoc, 1, &_focusColor.x);
-                if(_focusedTime == 0.f) _focusedTime = time;
-            }
-            else
-                glUniform3fv(_objectColorLoc, 1, &_objectColor.x);
+    for(GLuint i = 0; i < _count; i++)
+    {
+        if(_focused[i] && _focusedTimes[i] == 0.f)
+            _focusedTimes[i] = _time;
+
+        _movements[i] += _movingDistances[i] * float(dt);
+        _prevPositions[i] = _positions[i];
+        _positions[i] = _orgPositions[i] + _movements[i];
+
+        glm::vec3 objDir = _positions[i] - studioEnv.ViewPos;
+        float dotDir = glm::dot(objDir, studioEnv.Front);
+        /// Reset to start position (z = 0)
+        if((dotDir < 0.f) || (_focusedTimes[i] > 0.f && (_time - _focusedTimes[i] > FOCUSEDTIME))
+           || (_time - _startTimes[i] > 10.f))
+            ResetInstance(i, studioEnv);
     }
+}
+
+bool SphereObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& studioEnv)
+{
+    if(SetTextureToShader() == false)
+        return false;
+
+    const float scale = _S[0][0];
+    const float alpha = studioEnv.RenderAlpha;
 
-    /// Point light
-    for(int i = 0; i < NUM_POINT_LIGHTS; i++)
+    /// Only visible spheres are packed into the instance buffer
+    _drawCount = 0;
+    for(GLuint i = 0; i < _count; i++)
     {
-        string str("pointLights[");
-        str += (char)('0' + i);
-        str += "].position";
-        glUniform3fv(glGetUniformLocation(_pShader->GetProgram(), str.c_str()), 1, &studioEnv.PointLightPos[i].x);
+        if(!_visible[i])
+            continue;
+
+        glm::vec3& color = _focused[i] ? _focusColor : _colors[i];
+        glm::vec3 pos = glm::mix(_prevPositions[i], _positions[i], alpha);
+        _instances[_drawCount].PosScale = glm::vec4(pos, scale);
+        _instances[_drawCount].Color = glm::vec4(color, 1.f);
+        _drawCount++;
     }
 
-    glm::mat4 T(1.0f);
-    _movement += _movingDistance;
+    if(_drawCount == 0)
+        return true;
 
-    T[3][0] = _curPos.x = _orgPos.x + _movement.x;
-    T[3][1] = _curPos.y = _orgPos.y + _movement.y;
-    T[3][2] = _curPos.z = _orgPos.z + _movement.z;
+    if(_renderPath == SphereRender_Icosphere)
+        sortByIcoLevel(studioEnv);
 
-    ///printf("time (%.3f), z (%.3f), rsin (%.3f) \n", time, T[3][2], rsin);
-    glm::mat4 R(1.0f);
-    _modelMat = T* R *_S;
+    /// Orphan the previous storage so that the upload does not wait for the previous draw
+    glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+    glBufferData(GL_ARRAY_BUFFER, _count * sizeof(SphereInstance), NULL, GL_STREAM_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, _drawCount * sizeof(SphereInstance), &_instances[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    if(_PVLoc > -1) glUniformMatrix4fv(_PVLoc, 1, GL_FALSE,  &PV[0][0]);
-    if(_MLoc > -1) glUniformMatrix4fv(_MLoc, 1, GL_FALSE,  &_modelMat[0][0]);
-    if(_normalMatLoc > -1) glUniformMatrix3fv(_normalMatLoc, 1, GL_FALSE,  &_normalMat[0][0]);
+    _PVLoc.Set(PV);
 
-    DrawContainer();
+    /// Far spheres get fewer triangles, and patches out of view or facing away get none
+    for(GLuint i = 0; i < Frustum::NUM_PLANES; i++)
+        _frustumPlaneLocs[i].Set(_frustum.Planes[i]);
+    _tessPixelsLoc.Set(SPHERE_TESS_PIXELS);
+    _maxTessLevelLoc.Set(SPHERE_MAX_TESS_LEVEL);
 
-    glm::vec3 objDir = _curPos - studioEnv.ViewPos;
-    float dotDir = glm::dot(objDir, studioEnv.Front);
-    ///printf("dorDir %f \n", dotDir);
-    /// Reset to start position (z = 0)
-    if((dotDir < 0.f) || (_focusedTime > 0.f && (time - _focusedTime > FOCUSEDTIME))
-       || (time - _startTime > 10.f))
-        Reset(studioEnv);
+    DrawContainer();
 
     return true;
 }
 
+GLuint SphereObject::selectIcoLevel(const glm::vec4& posScale, StudioEnv& studioEnv)
+{
+    GLfloat distance = glm::length(glm::vec3(posScale) - studioEnv.ViewPos) - posScale.w;
+    if(distance <= 0.f)
+        return SPHERE_ICO_LEVELS - 1;
+
+    /// Each subdivision halves the edges. The first level is subdivided once.
+    GLfloat edgePixels = ICOSAHEDRON_EDGE * 0.5f * posScale.w * studioEnv.ProjScale / distance;
+    GLuint level = 0;
+    while(level + 1 < SPHERE_ICO_LEVELS && edgePixels > SPHERE_TESS_PIXELS)
+    {
+        edgePixels *= 0.5f;
+        level++;
+    }
+
+    return level;
+}
+
+void SphereObject::sortByIcoLevel(StudioEnv& studioEnv)
+{
+    memset(_levelCounts, 0, sizeof(_levelCounts));
+    _instanceLevels.resize(_drawCount);
+    for(GLuint i = 0; i < _drawCount; i++)
+    {
+        _instanceLevels[i] = selectIcoLevel(_instances[i].PosScale, studioEnv);
+        _levelCounts[_instanceLevels[i]]++;
+    }
+
+    /// Counting sort keeps spheres of a level next to each other, so each level is one instanced draw
+    GLuint slots[SPHERE_ICO_LEVELS] = { 0 };
+    for(GLuint i = 1; i < SPHERE_ICO_LEVELS; i++)
+        slots[i] = slots[i - 1] + _levelCounts[i - 1];
+
+    _sortedInstances.resize(_drawCount);
+    for(GLuint i = 0; i < _drawCount; i++)
+        _sortedInstances[slots[_instanceLevels[i]]++] = _instances[i];
+
+    std::copy(_sortedInstances.begin(), _sortedInstances.end(), _instances.begin());
+}
+
+bool SphereObject::CullByFrustum(const Frustum& frustum)
+{
+    const float radius = _S[0][0];
+    bool isVisible = false;
+
+    _frustum = frustum;
+
+    for(GLuint i = 0; i < _count; i++)
+    {
+        /// Rendering interpolates from the previous step, so the sphere covers the move
+        float bound = radius + glm::length(_positions[i] - _prevPositions[i]);
+        _visible[i] = frustum.IsSphereVisible(_positions[i], bound);
+        isVisible = isVisible || _visible[i];
+    }
+
+    return isVisible;
+}
+
 void SphereObject::Reset(StudioEnv& studioEnv)
 {
-    _orgPos = studioEnv.PlayerPos;
-    _movingDistance = decideMovingDistance(studioEnv);
-    _movement = glm::vec3(0.f);
-    _focusedTime = 0.f;
-    _startTime = glfwGetTime();
-    _isFocused = false;
-    _objectColor = decideObjectColor(studioEnv);
-    _seedNum = gSeedNum++;
+    for(GLuint i = 0; i < _count; i++)
+        ResetInstance(i, studioEnv);
+}
+
+void SphereObject::ResetInstance(uint32_t index, StudioEnv& studioEnv)
+{
+    _orgPositions[index] = studioEnv.PlayerPos;
+    _positions[index] = studioEnv.PlayerPos;
+    _prevPositions[index] = studioEnv.PlayerPos;
+    _movingDistances[index] = decideMovingDistance(index, studioEnv);
+    _movements[index] = glm::vec3(0.f);
+    _focusedTimes[index] = 0.f;
+    _startTimes[index] = _time;
+    _focused[index] = false;
+    _colors[index] = decideObjectColor(index, studioEnv);
+    _seedNums[index] = gSeedNum++;
+}
+
+void SphereObject::GetInstanceInfo(uint32_t index, struct ObjectInfo& objInfo)
+{
+    objInfo.CurPos = _positions[index];
+    objInfo.ObjColor = _colors[index];
+    objInfo.ObjType = _objType;
+    objInfo.ObjRadius = _S[0][0];
+}
+
+void SphereObject::GetCurObjectInfo(struct ObjectInfo& objInfo)
+{
+    GetInstanceInfo(_hitIndex > -1 ? _hitIndex : 0, objInfo);
+}
+
+void SphereObject::FocusInstance(uint32_t index, bool isFocused, glm::vec3 focusColor)
+{
+    /// Only one sphere of this object is focused at a time
+    if(_hitIndex > -1 && (uint32_t)_hitIndex != index)
+        _focused[_hitIndex] = false;
+
+    _hitIndex = index;
+    Focus(isFocused, focusColor);
+}
+
+void SphereObject::Focus(bool isFocused, glm::vec3 focusColor)
+{
+    if(_hitIndex < 0)
+        return;
+
+    _focused[_hitIndex] = isFocused;
+    if(isFocused)
+        _focusColor = focusColor;
 }
 
-glm::vec3 SphereObject::decideMovingDistance(StudioEnv& studioEnv)
+glm::vec3 SphereObject::decideMovingDistance(GLuint index, StudioEnv& studioEnv)
 {
-    glm::vec3 movement = glm::normalize(studioEnv.ViewPos - _orgPos) * DEFAULT_MOVING_DISTANCE * float(studioEnv.GameStage);
+    glm::vec3 movement = glm::normalize(studioEnv.ViewPos - _orgPositions[index]) * DEFAULT_MOVING_DISTANCE * float(studioEnv.GameStage);
 
-    srand(_seedNum);
+    srand(_seedNums[index]);
     float mov = (float)(rand() % 1000);
     /// choose the next position.
     movement *= (sin(glm::radians(mov)) + 1.50f);
@@ -172,11 +462,11 @@ glm::vec3 SphereObject::decideMovingDistance(StudioEnv& studioEnv)
     return movement;
 }
 
-glm::vec3 SphereObject::decideObjectColor(StudioEnv& studioEnv)
+glm::vec3 SphereObject::decideObjectColor(GLuint index, StudioEnv& studioEnv)
 {
     glm::vec3   color(0.f);
 
-    srand(_seedNum);
+    srand(_seedNums[index]);
     float mov = (float)(rand() % 1000);
 
     /// choose the object color.
@@ -189,36 +479,67 @@ glm::vec3 SphereObject::decideObjectColor(StudioEnv& studioEnv)
 
 void SphereObject::DrawContainer()
 {
-    /// Draw container
     glBindVertexArray(_vao);
-    glDrawElements(GL_PATCHES, _sizeIndices / sizeof(GLuint), GL_UNSIGNED_INT, 0);
+    if(_renderPath == SphereRender_Icosphere)
+    {
+        /// One instanced draw per level, reading its part of the instance buffer
+        glBindBuffer(GL_ARRAY_BUFFER, _instanceVbo);
+        GLuint firstInstance = 0;
+        for(GLuint i = 0; i < SPHERE_ICO_LEVELS; i++)
+        {
+            if(_levelCounts[i] == 0)
+                continue;
+
+            setInstanceAttribute(firstInstance);
+            glDrawElementsInstanced(GL_TRIANGLES, _icoIndexCount[i], GL_UNSIGNED_INT,
+                                    (GLvoid*)(_icoFirstIndex[i] * sizeof(GLuint)), _levelCounts[i]);
+            firstInstance += _levelCounts[i];
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    else
+        /// Draw all spheres at once
+        glDrawElementsInstanced(GL_PATCHES, _sizeIndices / sizeof(GLuint), GL_UNSIGNED_INT, 0, _drawCount);
     glBindVertexArray(0);
 
     if(_texturePath)
         glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-bool SphereObject::IsIntersected(glm::vec3 org, glm::vec3 dir, float *distance)
+bool SphereObject::GetInstanceBound(uint32_t index, glm::vec3& center, float& radius)
 {
-    glm::vec3 center(_modelMat[3][0], _modelMat[3][1], _modelMat[3][2]);
-    float radius = _S[0][0];
+    center = _positions[index];
+    radius = _S[0][0];
+    return true;
+}
 
-	/// work out components of quadratic
-	glm::vec3 objDir = center - org;
-	float objDist = glm::length(objDir);
+bool SphereObject::IsInstanceIntersected(uint32_t index, glm::vec3 org, glm::vec3 dir, float *distance)
+{
+    return IntersectRaySphere(org, dir, _positions[index], _S[0][0], *distance);
+}
 
-	/// calculate estimated casted position with this object
-    glm::vec3 castedPos = org + objDist * dir;
+bool SphereObject::IsIntersected(glm::vec3 org, glm::vec3 dir, float *distance)
+{
+    float closest = 0.f;
 
-    float dist = glm::length(center - castedPos);
+    _hitIndex = -1;
 
-	*distance = objDist;
+    for(GLuint i = 0; i < _count; i++)
+    {
+        float dist;
+        if(IsInstanceIntersected(i, org, dir, &dist) && (_hitIndex < 0 || dist < closest))
+        {
+            _hitIndex = i;
+            closest = dist;
+        }
+    }
 
-	printf("[%s] distance %f radius %f \n", __FUNCTION__, *distance, radius);
-	if(dist <= radius)
-        return true;
+    if(_hitIndex < 0)
+        return false;
+
+    *distance = closest;
 
-    return false;
+    return true;
 }
 
 }   /// namespace gl
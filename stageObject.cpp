@@ -39,14 +39,13 @@ bool StageObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& stud
     glm::mat4 modelMat = _T* R *_S;
     glm::mat4 PVM = PV * modelMat;
 
-    GLint PVMLoc = glGetUniformLocation (_pShader->GetProgram(), "PVM");
-	if(PVMLoc <= -1)
+	if(!_PVMLoc.IsValid())
     {
         LogError("Failed to get Uniform PVM \n");
         return false;
 	}
 
-    glUniformMatrix4fv(PVMLoc, 1, GL_FALSE,  &PVM[0][0]);
+    _PVMLoc.Set(PVM);
 
     DrawContainer();
 
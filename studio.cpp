@@ -1,5 +1,7 @@
 #include <cstdlib>
+#include <cstddef>
 #include <vector>
+#include <memory>
 #include <unistd.h>
 #include "windowManager.h"
 #include "logging.h"
@@ -32,7 +34,7 @@ static void keyCommandCallback(GLFWwindow *window, int key, int scancode, int ac
 
 static void frameBufferSizeChangedCallback(GLFWwindow* window, int width, int height);
 
-Studio::Studio() : _window(nullptr)
+Studio::Studio() : _window(nullptr), _envUbo(0), _isBvhDirty(true), _isLoaded(false), _numLoadingDone(~0u), _statusVersion(~0u)
 {
     /// for lighting
     _studioEnv.LightAmbient = glm::vec3(0.05f, 0.05f, 0.05f);
@@ -47,6 +49,9 @@ Studio::Studio() : _window(nullptr)
 
 Studio::~Studio()
 {
+    /// Workers may still be parsing. Wait for them before objects and the log go away.
+    _assetLoader.Stop();
+
     while(_objs.size() != 0)
     {
         IGraphicObject* obj = _objs.back();
@@ -67,12 +72,17 @@ Studio::~Studio()
         _shaders.pop_back();
     }
 
+    if(_envUbo)
+        glDeleteBuffers(1, &_envUbo);
+
     if(_window != nullptr)
     {
         glfwDestroyWindow(_window);      /// stop receiving events for the window and free resources
         QuitWindowManager();            /// clean-up rendering resources
     }
 
+    /// Write pending log messages and close the log file
+    StopLog();
 }
 
 bool Studio::ScreenSetting(uint32_t w, uint32_t h)
@@ -111,29 +121,45 @@ bool Studio::CameraSetting(glm::vec3 camPos, glm::vec3 lookAt, float near, float
     return true;
 }
 
+void Studio::updateStatusText()
+{
+    /// HUD strings are laid out again only when the game status changes
+    unsigned version = _gameControl.GetStatusVersion();
+    if(version == _statusVersion)
+        return;
+    _statusVersion = version;
+
+    char str[100];
+    sprintf(str, "Stage %d", _gameControl.GetCurStage());
+    _stageText.Set(str, glm::vec2(-100.f, 0.f), 2, glm::vec3(0.f, 1.f, 1.f));
+
+    sprintf(str, "Stage %d, Player %d, Enermy %d", _gameControl.GetCurStage(),
+            _gameControl.GetPlayerEnergy(), _gameControl.GetEnermyEnergy());
+    _statusText.Set(str, glm::vec2(100.f, 250.f), 1, glm::vec3(0.1f, 0.1f, 0.7f));
+}
+
 void Studio::displayGameStatus(const double time, glm::mat4 matrix, StudioEnv& studioEnv)
 {
+    updateStatusText();
+
     if(_gameControl.IsGameEnded())
     {
         _pIndicator->ChangeColor(glm::vec3(1.f, 0.f, 0.f));
         _pIndicator->DrawNextFrame(time, matrix, studioEnv);
-        _pTextRenderer->Print("Game Over !!!", glm::vec2(-150.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f), studioEnv);
+        _pTextRenderer->Draw(_gameOverText);
     }
     else {
-        char str[100];
-
         if(_gameControl.IsStageClearedStatus())
         {
             _pIndicator->ChangeColor(glm::vec3(0.f, 0.f, 0.7f));
             _pIndicator->DrawNextFrame(time, matrix, studioEnv);
-            sprintf(str, "Stage %d", _gameControl.GetCurStage());
-            _pTextRenderer->Print(str, glm::vec2(-100.f, 0.f), 2, glm::vec3(0.f, 1.f, 1.f), studioEnv);
+            _pTextRenderer->Draw(_stageText);
             studioEnv.GameStage = _gameControl.GetCurStage();
         }
         else if(_gameControl.IsDamagedStatus()) {
             _pIndicator->ChangeColor(glm::vec3(1.f, 0.f, 0.f));
             _pIndicator->DrawNextFrame(time, matrix, studioEnv);
-            _pTextRenderer->Print("Damaged !!!", glm::vec2(-100.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f), studioEnv);
+            _pTextRenderer->Draw(_damagedText);
         }
         else {
             _pIndicator->ChangeColor(glm::vec3(0.f));
@@ -141,21 +167,32 @@ void Studio::displayGameStatus(const double time, glm::mat4 matrix, StudioEnv& s
         }
 
         if(_gameControl.IsShotStatus()) {
-            _pTextRenderer->Print("+", glm::vec2(0.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f), studioEnv);
+            _pTextRenderer->Draw(_shotText);
         }
         /// display Current Status
-        sprintf(str, "Stage %d, Player %d, Enermy %d", _gameControl.GetCurStage(),
-                _gameControl.GetPlayerEnergy(), _gameControl.GetEnermyEnergy());
-
-        _pTextRenderer->Print(str, glm::vec2(100.f, 250.f), 1, glm::vec3(0.1f, 0.1f, 0.7f), studioEnv);
+        _pTextRenderer->Draw(_statusText);
     }
+
+    /// All strings of the frame are drawn at once
+    _pTextRenderer->Flush(studioEnv);
+}
+
+void Studio::updateObjects(const double dt, StudioEnv& studioEnv)
+{
+    for(uint32_t i = 0; i < _objs.size(); i++)
+        _objs[i]->Update(dt, studioEnv);
 }
 
-void Studio::renderNextFrame(const double time, glm::mat4 matrix, StudioEnv& studioEnv)
+void Studio::renderNextFrame(const double time, glm::mat4 matrix, const Frustum& frustum, StudioEnv& studioEnv)
 {
     for(uint32_t i = 0; i < _objs.size(); i++)
     {
         IGraphicObject* pObj = _objs[i];
+
+        /// Objects out of view are not drawn
+        if(!pObj->CullByFrustum(frustum))
+            continue;
+
         pObj->DrawNextFrame(time, matrix, studioEnv);
     }
 
@@ -176,20 +213,98 @@ void Studio::checkObjectsOnStage(StudioEnv& studioEnv)
         }
     }
 
-    IGraphicObject* pSphere = nullptr;
-    for(uint32_t i = 0; i < _objs.size(); i++) {
-        pSphere = _objs[i];
-        pSphere->GetCurObjectInfo(objInfo);
-        if(objInfo.ObjType == Object_Sphere
-           || objInfo.ObjType == Object_Model)
-        {
-            if(glm::length(objInfo.CurPos - _studioEnv.ViewPos) <= objInfo.ObjRadius + 2.0f) {
-                printf("ATTACKED!!! by %d \n", objInfo.ObjType);
-                pSphere->Reset(_studioEnv);
-                _gameControl.Damaged();
-            }
-        }
+    _broadphase.Update(_objs);
+
+    /// Bombs and the player close to the camera
+    _collisionHits.clear();
+    _broadphase.Query(studioEnv.ViewPos, CAMERA_RADIUS,
+                      SPATIAL_MASK(Object_Sphere) | SPATIAL_MASK(Object_Model), _collisionHits);
+    for(uint32_t i = 0; i < _collisionHits.size(); i++) {
+        const SpatialHashProxy* pHit = _collisionHits[i];
+        LogDebug("Attacked by instance %u \n", pHit->Index);
+        pHit->Obj->ResetInstance(pHit->Index, studioEnv);
+        _gameControl.Damaged();
+    }
+
+    /// Bombs hitting an asteroid go back to the player.
+    /// Pairs of one bomb are reported in a row, so it is reset only once.
+    _collisionPairs.clear();
+    _broadphase.QueryPairs(SPATIAL_MASK(Object_Sphere), SPATIAL_MASK(Object_Planet), _collisionPairs);
+    for(uint32_t i = 0; i < _collisionPairs.size(); i++) {
+        const SpatialHashProxy* pBomb = _collisionPairs[i].A;
+        if(i > 0 && _collisionPairs[i - 1].A == pBomb)
+            continue;
+        pBomb->Obj->ResetInstance(pBomb->Index, studioEnv);
+    }
+}
+
+void Studio::updateEnvBlock(StudioEnv& studioEnv)
+{
+    StudioEnvBlock block;
+
+    block.LightPos = glm::vec4(studioEnv.LightPos, 1.f);
+    block.LightAmbient = glm::vec4(studioEnv.LightAmbient, 1.f);
+    block.LightDiffuse = glm::vec4(studioEnv.LightDiffuse, 1.f);
+    block.LightSpecular = glm::vec4(studioEnv.LightSpecular, 1.f);
+    block.ViewPos = glm::vec4(studioEnv.ViewPos, 1.f);
+    block.ScreenSize = studioEnv.ScreenSize;
+    block.NumPointLights = glm::min(studioEnv.NumPointLights, MAX_POINT_LIGHTS);
+    block.ProjScale = studioEnv.ProjScale;
+
+    for(int i = 0; i < block.NumPointLights; i++)
+        block.PointLightPos[i] = glm::vec4(studioEnv.PointLightPos[i], 1.f);
+
+    /// Only the used part of the light array is uploaded.
+    GLsizeiptr size = offsetof(StudioEnvBlock, PointLightPos) + block.NumPointLights * sizeof(glm::vec4);
+
+    glBindBuffer(GL_UNIFORM_BUFFER, _envUbo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, size, &block);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void Studio::simulate(const double dt)
+{
+    /// Every object is updated before any draw,
+    /// so collision checks and rendering see the status of this step.
+    updateObjects(dt, _studioEnv);
+    checkObjectsOnStage(_studioEnv);
+
+    /// Refitted when the next ray is cast
+    _isBvhDirty = true;
+}
+
+bool Studio::finishCompiledShaders()
+{
+    /// Programs the driver has finished are checked now, so their first use does not wait
+    bool isAllFinished = true;
+    for(GLuint i = 0; i < _shaders.size(); i++)
+    {
+        if(_shaders[i]->IsCompleted())
+            _shaders[i]->Finish();
+        else
+            isAllFinished = false;
+    }
+
+    return isAllFinished;
+}
+
+void Studio::displayLoading(StudioEnv& studioEnv)
+{
+    /// Nothing can be printed until the font is uploaded
+    if(!_pTextRenderer || !_pTextRenderer->IsInitialized())
+        return;
+
+    if(_numLoadingDone != _assetLoader.GetNumDoneJobs())
+    {
+        _numLoadingDone = _assetLoader.GetNumDoneJobs();
+
+        char str[64];
+        sprintf(str, "Loading %u / %u", _numLoadingDone, _assetLoader.GetNumJobs());
+        _loadingText.Set(str, glm::vec2(-120.f, 0.f), 1, glm::vec3(1.f, 1.f, 1.f));
     }
+
+    _pTextRenderer->Draw(_loadingText);
+    _pTextRenderer->Flush(studioEnv);
 }
 
 void Studio::OnStage()
@@ -197,14 +312,15 @@ void Studio::OnStage()
     /// camera rotation
     double time = glfwGetTime();
 
-    _deltaTime = time - _lastRenderTime;
-    _lastRenderTime = time;
-
     glm::mat4 viewMat = _camera.GetViewMatrix();
     glm::mat4 projMat = _camera.GetProjMatrix();
 
-    checkObjectsOnStage(_studioEnv);
-    renderNextFrame( time, projMat * viewMat, _studioEnv);
+    /// Half the screen height spans tan(fov / 2) at distance 1
+    _studioEnv.ProjScale = projMat[1][1] * _studioEnv.ScreenSize.y * 0.5f;
+
+    updateEnvBlock(_studioEnv);
+    glm::mat4 PV = projMat * viewMat;
+    renderNextFrame( time, PV, Frustum(PV), _studioEnv);
 }
 
 void Studio::ProcessKeyCommand()
@@ -274,49 +390,82 @@ void Studio::ProcessFrameChangeCommand()
 
 void Studio::Casting()
 {
-    IGraphicObject* pObj;
-    IGraphicObject* pSelectedObj = nullptr;
+    /// Bounds are refitted only when picking, not every simulation step
+    if(_isBvhDirty)
+    {
+        _sceneBvh.Update(_objs);
+        _isBvhDirty = false;
+    }
 
-    float closest = 1000.0f;
-    float distance = 0.0f;
+    SceneBvhHit hit;
+    bool isHit = _sceneBvh.Cast(_camera.GetPosition(), glm::normalize(_camera.GetDirection()), hit);
 
     for (int i = 0; i < (int)_objs.size(); i++)
     {
-        pObj = _objs[i];
-        if (pObj->IsIntersected(_camera.GetPosition(), _camera.GetDirection(), &distance))
-        {
-            if (distance < closest)
-            {
-                if(pSelectedObj)
-                    pSelectedObj->Focus(false);
-                pSelectedObj = pObj;
-                pObj->Focus(true, glm::vec3(1.f, 0.f, 0.f));
-
-                struct ObjectInfo objInfo;
-                pObj->GetCurObjectInfo(objInfo);
-                if(objInfo.ObjType == Object_Model)
-                    _gameControl.AttackEnermy();
-
-                closest = distance;
-                continue;
-            }
-        }
-        pObj->Focus(false);
+        if (!isHit || _objs[i] != hit.Obj)
+            _objs[i]->Focus(false);
     }
+
+    if (!isHit)
+        return;
+
+    hit.Obj->FocusInstance(hit.Index, true, glm::vec3(1.f, 0.f, 0.f));
+
+    struct ObjectInfo objInfo;
+    hit.Obj->GetInstanceInfo(hit.Index, objInfo);
+    if(objInfo.ObjType == Object_Model)
+        _gameControl.AttackEnermy();
 }
 
 void Studio::Shoot()
 {
+    _lastRenderTime = glfwGetTime();
+    _simAccumulator = 0.0;
+
     /// the main render loop
     while (!glfwWindowShouldClose(_window)) {
 
+        double frameStartTime = glfwGetTime();
+
+        /// A long stall is not fed into the simulation at once, to avoid endless catching up.
+        double frameTime = glm::min(frameStartTime - _lastRenderTime, MAX_FRAME_TIME);
+        _deltaTime = frameTime;
+        _lastRenderTime = frameStartTime;
+
 		/** update other events like input handling */
 		glfwPollEvents();
 
-		ProcessKeyCommand();
-		ProcessMouseCommand();
+        /// Nothing on stage can be played with until loading is done
+        if(_isLoaded)
+        {
+            ProcessKeyCommand();
+            ProcessMouseCommand();
+        }
+        else
+            /// A shot fired at the loading screen is not kept for the stage
+            KeyCommands[GLFW_KEY_SPACE] = false;
 		ProcessFrameChangeCommand();
 
+        /// Loaded assets are uploaded within a time budget, so the window keeps responding while loading.
+        /// The simulation starts from the first frame after everything is on stage.
+        if(!_isLoaded)
+        {
+            bool isUploaded = _assetLoader.Update(ASSET_UPLOAD_BUDGET);
+            _isLoaded = finishCompiledShaders() && isUploaded;
+            frameTime = 0.0;
+        }
+
+        /// Run the simulation with a fixed time step, independent of the frame rate
+        _simAccumulator += frameTime;
+        while(_simAccumulator >= SIM_STEP)
+        {
+            simulate(SIM_STEP);
+            _simAccumulator -= SIM_STEP;
+        }
+
+        /// Rendering interpolates the previous and the current simulation step
+        _studioEnv.RenderAlpha = _simAccumulator / SIM_STEP;
+
         if(_command.allowToRender)
         {
             /// make the context of the given window current on the calling thread
@@ -326,7 +475,10 @@ void Studio::Shoot()
 
             glViewport( 0, 0, _w, _h);
 
-            OnStage();
+            if(_isLoaded)
+                OnStage();
+            else
+                displayLoading(_studioEnv);
 
             /// swap the back and front buffers
             glfwSwapBuffers(_window);
@@ -334,78 +486,196 @@ void Studio::Shoot()
 
         /// poll window events
         glfwPollEvents();
+
+        /// Limit the frame rate
+        if(_maxFrameRate > 0.f)
+        {
+            double remainTime = 1.0 / _maxFrameRate - (glfwGetTime() - frameStartTime);
+            if(remainTime > 0.0)
+                usleep((useconds_t)(remainTime * 1000000.0));
+        }
     }
 
     /// detach the context from the current thread
     glfwMakeContextCurrent(NULL);
 }
 
+/**
+ * @brief   A model being loaded. Shared by the load and the upload part of its job.
+ */
+struct ModelJob
+{
+    Model               Source;
+    vector<MeshData>    Meshes;
+    uint32_t            NumUploaded;        /// Meshes made into objects
+    bool                IsTextureUploaded;
+
+    explicit ModelJob(const char* path) : Source(path), NumUploaded(0), IsTextureUploaded(false) {}
+};
+
+void Studio::submitModel(const char* path, bool isPicked, vector<Shader*> shaders, function<IGraphicObject*(MeshData&)> makeObject)
+{
+    shared_ptr<ModelJob> pJob = make_shared<ModelJob>(path);
+    pJob->Source.SetBvhBuild(isPicked);
+
+    _assetLoader.Submit(path,
+        [pJob]() { return pJob->Source.Parse(); },
+        [this, path, pJob, shaders, makeObject]()
+        {
+            /// Textures first, then one mesh per step so a large model does not stall a frame
+            if(!pJob->IsTextureUploaded)
+            {
+                if(!pJob->Source.UploadTextures())
+                    LogError("[Studio] fail to upload textures of %s \n", path);
+                pJob->Meshes = pJob->Source.TakeMeshData();
+                pJob->IsTextureUploaded = true;
+                return pJob->Meshes.empty();
+            }
+
+            for(GLuint i = 0; i < shaders.size(); i++)
+            {
+                if(shaders[i] && !shaders[i]->IsCompleted())
+                    return false;
+            }
+
+            IGraphicObject* pObj = makeObject(pJob->Meshes[pJob->NumUploaded]);
+            _objs.push_back(pObj);
+            return ++pJob->NumUploaded == pJob->Meshes.size();
+        });
+}
+
 bool Studio::Ready()
 {
     Shader *pShaderBomb, *pShaderModel, *pShaderRect, *pShaderText, *pShaderPlanet;
 
-    pShaderBomb = new Shader("./glsl/sphereVs.glsl", "./glsl/sphereFs.glsl", "./glsl/sphereTcs.glsl",
-                          "./glsl/sphereTes.glsl", "./glsl/sphereGs.glsl"  );
-    pShaderBomb->Initialize();
+    /// Let the driver compile all programs at the same time
+    if(GLEW_ARB_parallel_shader_compile)
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+
+    /// Bombs are tessellated on GPU, or drawn as precomputed icospheres where tessellation is missing or slow
+    SphereRenderPath bombRenderPath = SphereObject::ChooseRenderPath(_bombRenderPath);
+
+    /// Programs are checked when they are used for the first time
+    if(bombRenderPath == SphereRender_Icosphere)
+        pShaderBomb = new Shader("./glsl/sphereIcoVs.glsl", "./glsl/sphereFs.glsl");
+    else
+        pShaderBomb = new Shader("./glsl/sphereVs.glsl", "./glsl/sphereFs.glsl", "./glsl/sphereTcs.glsl",
+                              "./glsl/sphereTes.glsl");
+    pShaderBomb->Submit();
     _shaders.push_back(pShaderBomb);
 
     pShaderModel = new Shader("./glsl/modelVs.glsl", "./glsl/modelFs.glsl");
-    pShaderModel->Initialize();
+    pShaderModel->Submit();
     _shaders.push_back(pShaderModel);
 
     pShaderPlanet = new Shader("./glsl/planetVs.glsl", "./glsl/planetFs.glsl");
-    pShaderPlanet->Initialize();
+    pShaderPlanet->Submit();
     _shaders.push_back(pShaderPlanet);
 
+    /// Asteroids are culled on GPU when compute shaders are available, otherwise on CPU
+    Shader* pShaderPlanetCull = nullptr;
+    if(GLEW_VERSION_4_3)
+    {
+        pShaderPlanetCull = new Shader("./glsl/planetCullCs.glsl");
+        pShaderPlanetCull->Submit();
+        _shaders.push_back(pShaderPlanetCull);
+    }
+
     pShaderRect = new Shader("./glsl/textureVs.glsl", "./glsl/rectFs.glsl");
-    pShaderRect->Initialize();
+    pShaderRect->Submit();
     _shaders.push_back(pShaderRect);
 
     pShaderText = new Shader("./glsl/textVs.glsl", "./glsl/textFs.glsl");
-    pShaderText->Initialize();
+    pShaderText->Submit();
     _shaders.push_back(pShaderText);
 
-    IGraphicObject* pObj;
+    /// Uniform buffer shared by all shaders which declare StudioEnvBlock
+    glGenBuffers(1, &_envUbo);
+    glBindBuffer(GL_UNIFORM_BUFFER, _envUbo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(StudioEnvBlock), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, STUDIO_ENV_BINDING, _envUbo);
 
-    for(int i = 0; i < 10; i++)
-    {
-        pObj = new SphereObject(pShaderBomb, glm::vec3(0.f));
-        pObj->Initialize();
-        pObj->Transform(glm::vec3(0.5f), glm::vec3(0.f, 0.f, -2.f));
-        _objs.push_back(pObj);
-    }
+    /// Files are read and decoded on worker threads, and uploaded by "Shoot" a little every frame.
+    /// The font comes first so the loading frame can show progress.
+    _pTextRenderer = new TextRenderer(pShaderText, "font/arial.ttf");
+    _assetLoader.Submit("font/arial.ttf",
+        [this]() { return _pTextRenderer->Load(); },
+        [this, pShaderText]()
+        {
+            if(!pShaderText->IsCompleted())
+                return false;
+
+            if(!_pTextRenderer->Initialize())
+                LogError("[Studio] fail to initialize the text renderer \n");
+            return true;
+        });
+
+    RectObject* pIndicator = new RectObject(pShaderRect, "./resource/Cockpit.png");
+    _pIndicator = pIndicator;
+    _assetLoader.Submit("./resource/Cockpit.png",
+        [pIndicator]() { return pIndicator->LoadTexture(); },
+        [this, pShaderRect]()
+        {
+            if(!pShaderRect->IsCompleted())
+                return false;
 
-    Model model("./resource/Aircraft/Aircraft.obj");
-    model.Parse();
-    vector<MeshData> meshData = model.GetMeshData();
+            _pIndicator->Initialize();
+            _pIndicator->Transform(glm::vec3(_studioEnv.ScreenSize.x, _studioEnv.ScreenSize.y, 0.f), glm::vec3(0.0f));
+            return true;
+        });
 
-    for(int i = 0; i < (int)meshData.size(); i++)
+    submitModel("./resource/Aircraft/Aircraft.obj", true, { pShaderModel }, [pShaderModel](MeshData& mesh)
     {
-        pObj = new MeshObject(pShaderModel, meshData[i].Vertices, meshData[i].Indices, meshData[i].Textures);
-        pObj->Initialize();
-        pObj->Transform(glm::vec3(2.f), glm::vec3(0.0f));
-        _objs.push_back(pObj);
-    }
-
-    Model planet("./resource/Rock/planet.obj");
-    ///Model planet("./resource/Rock/rock.obj");
-    planet.Parse();
-    vector<MeshData> planetData = planet.GetMeshData();
-
-    for(int i = 0; i < (int)planetData.size(); i++)
+        MeshObject* pMesh = new MeshObject(pShaderModel, std::move(mesh.Vertices),
+                                           std::move(mesh.Indices), std::move(mesh.Textures));
+        pMesh->ReleaseMeshDataAfterUpload(true);
+        pMesh->SetPackedVertex(true);
+        pMesh->SetBvh(std::move(mesh.Bvh));
+        pMesh->SetLods(std::move(mesh.Lods));
+        pMesh->Initialize();
+        pMesh->Transform(glm::vec3(2.f), glm::vec3(0.0f));
+        return (IGraphicObject*)pMesh;
+    });
+
+    ///submitModel("./resource/Rock/rock.obj", ...
+    submitModel("./resource/Rock/planet.obj", false, { pShaderPlanet, pShaderPlanetCull },
+                [pShaderPlanet, pShaderPlanetCull](MeshData& mesh)
     {
-        pObj = new PlanetObject(pShaderPlanet, planetData[i].Vertices, planetData[i].Indices, planetData[i].Textures);
-        pObj->Initialize();
-        pObj->Transform(glm::vec3(2.f), glm::vec3(0.f, 0.f, -30.0f));
-        _objs.push_back(pObj);
-    }
-
-    _pIndicator = new RectObject(pShaderRect, "./resource/Cockpit.png");
-    _pIndicator->Initialize();
-    _pIndicator->Transform(glm::vec3(_studioEnv.ScreenSize.x, _studioEnv.ScreenSize.y, 0.f), glm::vec3(0.0f));
-
-    _pTextRenderer = new TextRenderer(pShaderText, "font/arial.ttf");
-    _pTextRenderer->Initialize();
+        /// The culling program decides how asteroids are drawn. It is compiled by now, so this does not wait.
+        bool isGpuCulled = pShaderPlanetCull && pShaderPlanetCull->Finish();
+        Log("[Studio] asteroids are culled on %s \n", isGpuCulled ? "GPU" : "CPU");
+
+        PlanetObject* pPlanet = new PlanetObject(pShaderPlanet, std::move(mesh.Vertices),
+                                                 std::move(mesh.Indices), std::move(mesh.Textures));
+        pPlanet->ReleaseMeshDataAfterUpload(true);
+        pPlanet->SetPackedVertex(true);
+        pPlanet->SetLods(std::move(mesh.Lods));
+        pPlanet->SetCullShader(isGpuCulled ? pShaderPlanetCull : nullptr);
+        pPlanet->Initialize();
+        pPlanet->Transform(glm::vec3(2.f), glm::vec3(0.f, 0.f, -30.0f));
+        return (IGraphicObject*)pPlanet;
+    });
+
+    /// All bombs are drawn by one instanced sphere object.
+    /// The tessellation program takes long to link, so the object is made once the driver is done with it.
+    _assetLoader.Submit("bombs", nullptr, [this, pShaderBomb, bombRenderPath]()
+    {
+        if(!pShaderBomb->IsCompleted())
+            return false;
+
+        SphereObject* pBombs = new SphereObject(pShaderBomb, glm::vec3(0.f), NUM_BOMBS);
+        pBombs->SetRenderPath(bombRenderPath);
+        pBombs->Initialize();
+        pBombs->Transform(glm::vec3(0.5f), glm::vec3(0.f, 0.f, -2.f));
+        _objs.push_back(pBombs);
+        return true;
+    });
+
+    /// Fixed HUD strings are laid out once
+    _gameOverText.Set("Game Over !!!", glm::vec2(-150.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f));
+    _damagedText.Set("Damaged !!!", glm::vec2(-100.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f));
+    _shotText.Set("+", glm::vec2(0.f, 0.f), 2, glm::vec3(1.f, 0.f, 0.f));
 
     return true;
 }
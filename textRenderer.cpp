@@ -1,3 +1,6 @@
+#include <math.h>
+#include <stddef.h>
+#include <algorithm>
 #include <glm/gtc/matrix_transform.hpp>
 #include "textRenderer.h"
 #include "logging.h"
@@ -6,17 +9,135 @@ namespace gl{
 
 using namespace std;
 
-TextRenderer::TextRenderer(Shader* pShader, const char* fontPath) : _fontPath(fontPath)
+namespace
+{
+
+const float DISTANCE_INF = 1e20f;
+
+/**
+ * @brief   Squared distance transform of a sampled function in one dimension
+ *          (Felzenszwalb and Huttenlocher, lower envelope of parabolas)
+ */
+void DistanceTransform1D(float* f, GLint n, vector<float>& d, vector<GLint>& v, vector<float>& z)
+{
+    GLint k = 0;
+    v[0] = 0;
+    z[0] = -DISTANCE_INF;
+    z[1] = DISTANCE_INF;
+
+    for (GLint q = 1; q < n; q++)
+    {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.f * (q - v[k]));
+        while (s <= z[k])
+        {
+            k--;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.f * (q - v[k]));
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = DISTANCE_INF;
+    }
+
+    k = 0;
+    for (GLint q = 0; q < n; q++)
+    {
+        while (z[k + 1] < q)
+            k++;
+        d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+    }
+
+    for (GLint q = 0; q < n; q++)
+        f[q] = d[q];
+}
+
+/**
+ * @brief   Exact squared Euclidean distance to the nearest zero texel, in place
+ */
+void DistanceTransform2D(vector<float>& grid, GLint w, GLint h)
+{
+    GLint n = std::max(w, h);
+    vector<float> f(n), d(n), z(n + 1);
+    vector<GLint> v(n);
+
+    for (GLint x = 0; x < w; x++)
+    {
+        for (GLint y = 0; y < h; y++)
+            f[y] = grid[y * w + x];
+        DistanceTransform1D(&f[0], h, d, v, z);
+        for (GLint y = 0; y < h; y++)
+            grid[y * w + x] = f[y];
+    }
+
+    for (GLint y = 0; y < h; y++)
+        DistanceTransform1D(&grid[y * w], w, d, v, z);
+}
+
+/**
+ * @brief   Signed distance field of a glyph rasterized FONT_SDF_UPSCALE times larger than the field
+ *          0.5 is the outline. Values grow inside the glyph and reach 0 at FONT_SDF_SPREAD texels outside.
+ */
+void BuildGlyphSdf(const FT_Bitmap& bitmap, GLint sdfW, GLint sdfH, vector<GLubyte>& sdf)
+{
+    const GLint upscale = FONT_SDF_UPSCALE;
+    const GLint pad = FONT_SDF_SPREAD * upscale;
+    GLint w = sdfW * upscale;
+    GLint h = sdfH * upscale;
+
+    /// Distances to the nearest inside texel and to the nearest outside texel
+    vector<float> toInside(w * h), toOutside(w * h);
+    for (GLint y = 0; y < h; y++)
+        for (GLint x = 0; x < w; x++)
+        {
+            GLint bx = x - pad, by = y - pad;
+            bool isInside = bx >= 0 && by >= 0 && bx < (GLint)bitmap.width && by < (GLint)bitmap.rows
+                            && bitmap.buffer[by * bitmap.pitch + bx] >= 128;
+            toInside[y * w + x] = isInside ? 0.f : DISTANCE_INF;
+            toOutside[y * w + x] = isInside ? DISTANCE_INF : 0.f;
+        }
+
+    DistanceTransform2D(toInside, w, h);
+    DistanceTransform2D(toOutside, w, h);
+
+    sdf.resize(sdfW * sdfH);
+    for (GLint sy = 0; sy < sdfH; sy++)
+        for (GLint sx = 0; sx < sdfW; sx++)
+        {
+            /// Average over the high resolution texels covered by a field texel
+            float sum = 0.f;
+            for (GLint y = sy * upscale; y < (sy + 1) * upscale; y++)
+                for (GLint x = sx * upscale; x < (sx + 1) * upscale; x++)
+                {
+                    GLint i = y * w + x;
+                    /// The outline lies half a texel off the nearest texel center
+                    sum += (toInside[i] > 0.f) ? sqrtf(toInside[i]) - 0.5f : 0.5f - sqrtf(toOutside[i]);
+                }
+
+            float distance = sum / (upscale * upscale) / upscale;
+            float value = 0.5f - distance / (2.f * FONT_SDF_SPREAD);
+            sdf[sy * sdfW + sx] = (GLubyte)(glm::clamp(value, 0.f, 1.f) * 255.f + 0.5f);
+        }
+}
+
+}   /// namespace
+
+TextRenderer::TextRenderer(Shader* pShader, const char* fontPath) : _fontPath(fontPath),
+    _atlas(0), _atlasHeight(0), _vbo(0), _vao(0), _vboSize(0), _vertexCount(0), _isQueueDirty(false)
 {
     _pShader = pShader;
 }
 
 TextRenderer::~TextRenderer()
 {
-
+    if(_atlas)
+        glDeleteTextures(1, &_atlas);
+    if(_vbo)
+        glDeleteBuffers(1, &_vbo);
+    if(_vao)
+        glDeleteVertexArrays(1, &_vao);
 }
 
-bool TextRenderer::generateFontTexures()
+bool TextRenderer::Load()
 {
     FT_Library ft;
     if (FT_Init_FreeType(&ft)) {
@@ -27,77 +148,201 @@ bool TextRenderer::generateFontTexures()
     FT_Face face;
     if (FT_New_Face(ft, _fontPath.c_str(), 0, &face)) {
         Log("[TextRenderer] Fail to load font file %s \n", _fontPath.c_str());
+        FT_Done_FreeType(ft);
         return false;
     }
 
-    FT_Set_Pixel_Sizes(face, 0, 20);
+    FT_Set_Pixel_Sizes(face, 0, FONT_SDF_SIZE * FONT_SDF_UPSCALE);
 
-    /// OpenGL requires that textures all have a 4-byte alignment
-    /// By setting its unpack alignment equal to 1, there would be no alignment issues
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    /// Atlas texels into pixels of FONT_PIXEL_SIZE
+    const GLfloat layoutScale = (GLfloat)FONT_PIXEL_SIZE / FONT_SDF_SIZE;
+
+    /// Glyphs are packed row by row. A glyph not fitting the current row starts a new one.
+    vector<GLubyte> pixels, sdf;
+    GLint penX = FONT_ATLAS_PADDING, penY = FONT_ATLAS_PADDING;
+    GLint rowHeight = 0, usedHeight = 0;
 
-    for (GLubyte c = 0; c < 128; c++)
+    for (GLubyte c = 0; c < NUM_GLYPHS; c++)
     {
+        CharInfo& ch = _chars[c];
+        ch.UvMin = ch.UvMax = ch.Size = ch.Bearing = glm::vec2(0.f);
+        ch.Advance = 0.f;
+
         /// Load a glyph of char
         if (FT_Load_Char(face, c, FT_LOAD_RENDER)) {
             Log("[TextRenderer] Fail to load a glyph for %c \n", c);
             continue;
         }
 
-        /// Generates texture images
-        GLuint texObj;
-        glGenTextures(1, &texObj);
-        glBindTexture(GL_TEXTURE_2D, texObj);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RED,
-            face->glyph->bitmap.width,
-            face->glyph->bitmap.rows,
-            0, GL_RED, GL_UNSIGNED_BYTE,
-            face->glyph->bitmap.buffer
-        );
-
-        /// Set texture options
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        CharInfo charInfo = {texObj,
-            glm::ivec2(face->glyph->bitmap.width, face->glyph->bitmap.rows),
-            glm::ivec2(face->glyph->bitmap_left, face->glyph->bitmap_top),
-            face->glyph->advance.x
-        };
-
-        _charMap.insert(std::pair<GLchar, CharInfo>(c, charInfo));
+        const FT_GlyphSlot glyph = face->glyph;
+        ch.Advance = glyph->advance.x / 64.f / FONT_SDF_UPSCALE * layoutScale;
+
+        /// Spaces have no outline
+        if (glyph->bitmap.width == 0 || glyph->bitmap.rows == 0)
+            continue;
+
+        GLint w = (glyph->bitmap.width + FONT_SDF_UPSCALE - 1) / FONT_SDF_UPSCALE + 2 * FONT_SDF_SPREAD;
+        GLint h = (glyph->bitmap.rows + FONT_SDF_UPSCALE - 1) / FONT_SDF_UPSCALE + 2 * FONT_SDF_SPREAD;
+        BuildGlyphSdf(glyph->bitmap, w, h, sdf);
+
+        if (penX + w + FONT_ATLAS_PADDING > FONT_ATLAS_WIDTH) {
+            penX = FONT_ATLAS_PADDING;
+            penY += rowHeight + FONT_ATLAS_PADDING;
+            rowHeight = 0;
+        }
+
+        if (penY + h + FONT_ATLAS_PADDING > usedHeight) {
+            usedHeight = penY + h + FONT_ATLAS_PADDING;
+            pixels.resize(FONT_ATLAS_WIDTH * usedHeight, 0);
+        }
+
+        for (GLint y = 0; y < h; y++)
+            std::copy(&sdf[y * w], &sdf[y * w] + w, &pixels[(penY + y) * FONT_ATLAS_WIDTH + penX]);
+
+        ch.UvMin = glm::vec2(penX, penY);
+        ch.UvMax = glm::vec2(penX + w, penY + h);
+        ch.Size = glm::vec2(w, h) * layoutScale;
+        ch.Bearing = glm::vec2((GLfloat)glyph->bitmap_left / FONT_SDF_UPSCALE - FONT_SDF_SPREAD,
+                               (GLfloat)glyph->bitmap_top / FONT_SDF_UPSCALE + FONT_SDF_SPREAD) * layoutScale;
+
+        penX += w + FONT_ATLAS_PADDING;
+        rowHeight = std::max(rowHeight, h);
     }
-    glBindTexture(GL_TEXTURE_2D, 0);
 
     FT_Done_Face(face);
     FT_Done_FreeType(ft);
 
+    GLint atlasHeight = 1;
+    while (atlasHeight < usedHeight)
+        atlasHeight <<= 1;
+    pixels.resize(FONT_ATLAS_WIDTH * atlasHeight, 0);
+
+    /// Texel rectangles into texture coordinates
+    glm::vec2 atlasSize(FONT_ATLAS_WIDTH, atlasHeight);
+    for (GLuint c = 0; c < NUM_GLYPHS; c++) {
+        _chars[c].UvMin /= atlasSize;
+        _chars[c].UvMax /= atlasSize;
+    }
+
+    _atlasPixels.swap(pixels);
+    _atlasHeight = atlasHeight;
+
     return true;
 }
 
-bool TextRenderer::Initialize()
+bool TextRenderer::uploadFontAtlas()
 {
-    if(!generateFontTexures())
+    if (_atlasPixels.empty())
         return false;
 
-    glGenVertexArrays(1, &_vao);
-    glGenBuffers(1, &_vbo);
-    glBindVertexArray(_vao);
-    glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-    /// reserve enough memory and update later when rendering characters.
-    /// So, GL_DYNAMIC_DRAW is chosen.
-    glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * 6 * 4, NULL, GL_DYNAMIC_DRAW);
+    /// OpenGL requires that textures all have a 4-byte alignment
+    /// By setting its unpack alignment equal to 1, there would be no alignment issues
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glGenTextures(1, &_atlas);
+    glBindTexture(GL_TEXTURE_2D, _atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, FONT_ATLAS_WIDTH, _atlasHeight, 0, GL_RED, GL_UNSIGNED_BYTE, &_atlasPixels[0]);
+
+    /// Set texture options
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    Log("[TextRenderer] Font atlas %dx%d for %d glyphs \n", FONT_ATLAS_WIDTH, _atlasHeight, NUM_GLYPHS);
+
+    /// The texture keeps its own copy
+    vector<GLubyte>().swap(_atlasPixels);
+
+    return true;
+}
+
+TextLayout::TextLayout() : _pos(0.f), _scale(1.f), _fontColor(0.f), _isDirty(false)
+{
+}
+
+void TextLayout::Set(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor)
+{
+    if(_str == str && _pos == pos && _scale == scale && _fontColor == fontColor)
+        return;
+
+    _str = str;
+    _pos = pos;
+    _scale = scale;
+    _fontColor = fontColor;
+    _isDirty = true;
+}
+
+void TextRenderer::setupVertexArray(GLuint vao, GLuint vbo)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), 0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)offsetof(TextVertex, PosUv));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(TextVertex), (GLvoid*)offsetof(TextVertex, Color));
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+}
+
+bool TextRenderer::Initialize()
+{
+    /// The atlas is built here unless "Load" ran in advance
+    if(_atlasPixels.empty() && !Load())
+        return false;
+
+    if(!uploadFontAtlas())
+        return false;
+
+    /// Storage is allocated when the first text is flushed
+    glGenVertexArrays(1, &_vao);
+    glGenBuffers(1, &_vbo);
+    setupVertexArray(_vao, _vbo);
+
+    _projLoc = _pShader->GetUniform("proj");
+    _texImgLoc = _pShader->GetUniform("texImg");
 
     return true;
 }
 
-void TextRenderer::Print(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor, StudioEnv& studioEnv)
+void TextRenderer::layoutGlyphs(const char* str, glm::vec2 pos, GLfloat scale, glm::vec3 fontColor,
+                                vector<TextVertex>& vertices) const
+{
+    for (int i = 0; str[i] != '\0'; i++)
+    {
+        GLubyte c = str[i];
+        if (c >= NUM_GLYPHS)
+            continue;
+
+        const CharInfo& ch = _chars[c];
+
+        /// Spaces only move the pen
+        if (ch.Size.x > 0.f && ch.Size.y > 0.f)
+        {
+            GLfloat xPos = pos.x + ch.Bearing.x * scale;
+            GLfloat yPos = pos.y - (ch.Size.y - ch.Bearing.y) * scale;
+
+            GLfloat w = ch.Size.x * scale;
+            GLfloat h = ch.Size.y * scale;
+
+            TextVertex quad[6] = {
+                { glm::vec4(xPos,     yPos + h,   ch.UvMin.x, ch.UvMin.y), fontColor },
+                { glm::vec4(xPos,     yPos,       ch.UvMin.x, ch.UvMax.y), fontColor },
+                { glm::vec4(xPos + w, yPos,       ch.UvMax.x, ch.UvMax.y), fontColor },
+
+                { glm::vec4(xPos,     yPos + h,   ch.UvMin.x, ch.UvMin.y), fontColor },
+                { glm::vec4(xPos + w, yPos,       ch.UvMax.x, ch.UvMax.y), fontColor },
+                { glm::vec4(xPos + w, yPos + h,   ch.UvMax.x, ch.UvMin.y), fontColor }
+            };
+            vertices.insert(vertices.end(), quad, quad + 6);
+        }
+
+        pos.x += ch.Advance * scale;
+    }
+}
+
+void TextRenderer::beginDraw(StudioEnv& studioEnv)
 {
     _pShader->Use();
 
@@ -110,51 +355,62 @@ void TextRenderer::Print(const char* str, glm::vec2 pos, GLfloat scale, glm::vec
                    0, 0, -2/(far - near), 0,
                    0, 0, (far + near)/(near - far), 1);
 
-    glUniformMatrix4fv(glGetUniformLocation(_pShader->GetProgram(), "proj"), 1, GL_FALSE, &proj[0][0]);
-    glUniform3f(glGetUniformLocation(_pShader->GetProgram(), "fontColor"), fontColor.x, fontColor.y, fontColor.z);
-    glUniform1i(glGetUniformLocation(_pShader->GetProgram(), "texImg"), 0);
+    _projLoc.Set(proj);
+    _texImgLoc.Set(0);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindVertexArray(_vao);
+    glBindTexture(GL_TEXTURE_2D, _atlas);
+}
 
-    /// render all characters in the input string
-    for (int i = 0; str[i] != '\0'; i++)
+void TextRenderer::Draw(TextLayout& layout)
+{
+    if (layout._isDirty)
+    {
+        layout._vertices.clear();
+        layoutGlyphs(layout._str.c_str(), layout._pos, layout._scale, layout._fontColor, layout._vertices);
+        layout._isDirty = false;
+        _isQueueDirty = true;
+    }
+
+    _queue.push_back(&layout);
+}
+
+void TextRenderer::Flush(StudioEnv& studioEnv)
+{
+    /// The same unchanged layouts as the previous flush are already in the buffer
+    if (_isQueueDirty || _queue != _uploaded)
     {
-        char c = str[i];
-        CharInfo ch = _charMap[c];
-
-        GLfloat xPos = pos.x + ch.Bearing.x * scale;
-        GLfloat yPos = pos.y - (ch.Size.y - ch.Bearing.y) * scale;
-
-        GLfloat w = ch.Size.x * scale;
-        GLfloat h = ch.Size.y * scale;
-
-        /// Update VBO for each character
-        GLfloat vertices[6][4] = {
-            { xPos,     yPos + h,   0.0, 0.0 },
-            { xPos,     yPos,       0.0, 1.0 },
-            { xPos + w, yPos,       1.0, 1.0 },
-
-            { xPos,     yPos + h,   0.0, 0.0 },
-            { xPos + w, yPos,       1.0, 1.0 },
-            { xPos + w, yPos + h,   1.0, 0.0 }
-        };
-        /// Render glyph texture over quad
-        glBindTexture(GL_TEXTURE_2D, ch.texObj);
-        /// Update content of VBO memory
+        vector<TextVertex> vertices;
+        for (GLuint i = 0; i < _queue.size(); i++)
+            vertices.insert(vertices.end(), _queue[i]->_vertices.begin(), _queue[i]->_vertices.end());
+
+        GLsizeiptr size = vertices.size() * sizeof(TextVertex);
         glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+        if (size > _vboSize) {
+            _vboSize = size;
+            glBufferData(GL_ARRAY_BUFFER, size, vertices.data(), GL_DYNAMIC_DRAW);
+        }
+        else if (size > 0) {
+            /// Orphan the storage used by the previous frame, so the upload does not wait for it
+            glBufferData(GL_ARRAY_BUFFER, _vboSize, NULL, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, size, vertices.data());
+        }
         glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        /// advance is number of 1/64 pixels
-        /// so can be shifted by multiplying 64 ( 2 >> 6 ).
-        pos.x += (ch.Advance >> 6) * scale;
+        _vertexCount = vertices.size();
+        _uploaded = _queue;
+        _isQueueDirty = false;
     }
+    _queue.clear();
 
+    if (_vertexCount == 0)
+        return;
+
+    beginDraw(studioEnv);
+    glBindVertexArray(_vao);
+    glDrawArrays(GL_TRIANGLES, 0, _vertexCount);
     glBindVertexArray(0);
     glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-
 }
@@ -0,0 +1,285 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <SOIL.h>
+#include <image_helper.h>
+extern "C" {
+#include <image_DXT.h>
+}
+#include "textureCache.h"
+#include "logging.h"
+
+#define DDS_FOURCC(a, b, c, d)  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+namespace gl
+{
+
+namespace
+{
+
+/// Bytes of a compressed level. S3TC stores blocks of 4x4 texels.
+size_t CompressedSize(GLenum format, int width, int height)
+{
+    size_t blockBytes = (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+}
+
+/**
+ * @brief   Read a DDS cache. It is valid only if it was made from a source of the same size and modified time.
+ */
+bool ReadCache(const string& cachePath, const struct stat& srcStat, TextureImage& image)
+{
+    FILE* file = fopen(cachePath.c_str(), "rb");
+    if(!file)
+        return false;
+
+    DDS_header header;
+    bool result = fread(&header, sizeof(header), 1, file) == 1
+                  && header.dwMagic == DDS_FOURCC('D', 'D', 'S', ' ')
+                  && header.dwReserved1[0] == TEXTURE_CACHE_MAGIC
+                  && header.dwReserved1[1] == TEXTURE_CACHE_VERSION
+                  && header.dwReserved1[2] == (uint32_t)srcStat.st_size
+                  && header.dwReserved1[3] == (uint32_t)srcStat.st_mtime
+                  && header.dwWidth > 0 && header.dwWidth <= TEXTURE_CACHE_MAX_SIZE
+                  && header.dwHeight > 0 && header.dwHeight <= TEXTURE_CACHE_MAX_SIZE
+                  && header.dwMipMapCount > 0;
+
+    /// A full chain halves the larger side down to 1
+    if(result)
+    {
+        uint32_t maxLevels = 1;
+        for(uint32_t size = std::max(header.dwWidth, header.dwHeight); size > 1; size /= 2)
+            maxLevels++;
+        result = header.dwMipMapCount <= maxLevels;
+    }
+
+    if(result)
+    {
+        if(header.sPixelFormat.dwFourCC == DDS_FOURCC('D', 'X', 'T', '1'))
+            image.Format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        else if(header.sPixelFormat.dwFourCC == DDS_FOURCC('D', 'X', 'T', '5'))
+            image.Format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        else
+            result = false;
+    }
+
+    if(result)
+    {
+        /// Levels follow the header from the largest one
+        int width = header.dwWidth, height = header.dwHeight;
+        size_t offset = 0;
+        for(uint32_t i = 0; i < header.dwMipMapCount; i++)
+        {
+            TextureLevel level = { width, height, offset, CompressedSize(image.Format, width, height) };
+            image.Levels.push_back(level);
+            offset += level.Size;
+            width = std::max(width / 2, 1);
+            height = std::max(height / 2, 1);
+        }
+
+        /// A truncated cache is rejected before the levels are allocated
+        struct stat cacheStat;
+        result = fstat(fileno(file), &cacheStat) == 0
+                 && (uint64_t)cacheStat.st_size >= sizeof(header) + (uint64_t)offset;
+        if(result)
+        {
+            image.Data.resize(offset);
+            result = fread(&image.Data[0], 1, offset, file) == offset;
+        }
+    }
+    fclose(file);
+
+    if(!result)
+    {
+        image.Levels.clear();
+        image.Data.clear();
+    }
+
+    return result;
+}
+
+/**
+ * @brief   Write a DDS cache with all mip levels. The source is recorded in the reserved words.
+ */
+bool WriteCache(const string& cachePath, const struct stat& srcStat, const TextureImage& image)
+{
+    DDS_header header;
+    memset(&header, 0, sizeof(header));
+    header.dwMagic = DDS_FOURCC('D', 'D', 'S', ' ');
+    header.dwSize = 124;
+    header.dwFlags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    header.dwWidth = image.Levels[0].Width;
+    header.dwHeight = image.Levels[0].Height;
+    header.dwPitchOrLinearSize = image.Levels[0].Size;
+    header.dwMipMapCount = image.Levels.size();
+    header.dwReserved1[0] = TEXTURE_CACHE_MAGIC;
+    header.dwReserved1[1] = TEXTURE_CACHE_VERSION;
+    header.dwReserved1[2] = (uint32_t)srcStat.st_size;
+    header.dwReserved1[3] = (uint32_t)srcStat.st_mtime;
+    header.sPixelFormat.dwSize = 32;
+    header.sPixelFormat.dwFlags = DDPF_FOURCC;
+    header.sPixelFormat.dwFourCC = (image.Format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ?
+                                   DDS_FOURCC('D', 'X', 'T', '1') : DDS_FOURCC('D', 'X', 'T', '5');
+    header.sCaps.dwCaps1 = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+    string tempPath = cachePath + ".tmp";
+    FILE* file = fopen(tempPath.c_str(), "wb");
+    if(!file)
+        return false;
+
+    bool result = fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(&image.Data[0], 1, image.Data.size(), file) == image.Data.size();
+
+    if(fclose(file) != 0)
+        result = false;
+
+    /// Readers never see a partially written cache
+    if(!result || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief   Compress an image and its mip chain down to 1x1
+ *          Each level is box filtered from the previous one, same as glGenerateMipmap does.
+ */
+bool CompressImage(const unsigned char* pixels, int width, int height, int channels, TextureImage& image)
+{
+    image.Format = (channels == 4) ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    vector<unsigned char> level, halfLevel;
+    const unsigned char* src = pixels;
+
+    while(true)
+    {
+        int size = 0;
+        unsigned char* dxt = (channels == 4) ? convert_image_to_DXT5(src, width, height, channels, &size)
+                                             : convert_image_to_DXT1(src, width, height, channels, &size);
+        if(dxt == NULL)
+            return false;
+
+        TextureLevel textureLevel = { width, height, image.Data.size(), (size_t)size };
+        image.Levels.push_back(textureLevel);
+        image.Data.insert(image.Data.end(), dxt, dxt + size);
+        free(dxt);
+
+        if(width == 1 && height == 1)
+            break;
+
+        int halfWidth = std::max(width / 2, 1);
+        int halfHeight = std::max(height / 2, 1);
+        halfLevel.resize(halfWidth * halfHeight * channels);
+        mipmap_image(src, width, height, channels, &halfLevel[0], 2, 2);
+
+        level.swap(halfLevel);
+        src = &level[0];
+        width = halfWidth;
+        height = halfHeight;
+    }
+
+    return true;
+}
+
+}   /// namespace
+
+bool LoadTextureImage(const string& path, bool hasAlpha, TextureImage& image)
+{
+    image.Levels.clear();
+    image.Data.clear();
+
+    /// Drivers without S3TC get the source pixels as they were
+    struct stat srcStat;
+    bool isCompressible = GLEW_EXT_texture_compression_s3tc && stat(path.c_str(), &srcStat) == 0;
+    string cachePath = path + TEXTURE_CACHE_EXT;
+
+    if(isCompressible && ReadCache(cachePath, srcStat, image))
+    {
+        image.IsCompressed = true;
+        LogDebug("[Texture] %s is loaded from the cache \n", path.c_str());
+        return true;
+    }
+
+    int width, height;
+    int channels = hasAlpha ? 4 : 3;
+    unsigned char* pixels = SOIL_load_image(path.c_str(), &width, &height, 0, hasAlpha ? SOIL_LOAD_RGBA : SOIL_LOAD_RGB);
+    if(pixels == NULL)
+    {
+        LogError("SOIL_load_image fail (%s) \n", path.c_str());
+        return false;
+    }
+
+    if(isCompressible && CompressImage(pixels, width, height, channels, image))
+    {
+        image.IsCompressed = true;
+        if(WriteCache(cachePath, srcStat, image))
+            Log("[Texture] %s is compressed into %s \n", path.c_str(), cachePath.c_str());
+        else
+            LogError("[Texture] fail to write %s \n", cachePath.c_str());
+    }
+    else
+    {
+        image.Levels.clear();
+        image.Data.assign(pixels, pixels + width * height * channels);
+
+        TextureLevel level = { width, height, 0, image.Data.size() };
+        image.Levels.push_back(level);
+        image.Format = hasAlpha ? GL_RGBA : GL_RGB;
+        image.IsCompressed = false;
+    }
+
+    SOIL_free_image_data(pixels);
+    return true;
+}
+
+GLuint CreateTextureObject(const TextureImage& image, GLint wrap)
+{
+    if(image.Levels.empty())
+        return 0;
+
+    GLuint textureObj;
+    glGenTextures(1, &textureObj);
+
+    /// All upcoming GL_TEXTURE_2D operations now have effect on this texture object
+    glBindTexture(GL_TEXTURE_2D, textureObj);
+
+    /// Set texture parameters
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+
+    /// Set texture filtering
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    if(image.IsCompressed)
+    {
+        /// Mip levels are precomputed
+        for(GLuint i = 0; i < image.Levels.size(); i++)
+        {
+            const TextureLevel& level = image.Levels[i];
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, image.Format, level.Width, level.Height, 0,
+                                   level.Size, &image.Data[level.Offset]);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.Levels.size() - 1);
+    }
+    else
+    {
+        /// Create texture and generate mipmaps
+        const TextureLevel& level = image.Levels[0];
+        glTexImage2D(GL_TEXTURE_2D, 0, image.Format, level.Width, level.Height, 0,
+                     image.Format, GL_UNSIGNED_BYTE, &image.Data[0]);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    /// Unbind texture when done, so we won't accidentally mess up our texture.
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return textureObj;
+}
+
+}   /// namespace gl
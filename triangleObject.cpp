@@ -2,7 +2,6 @@
 #include <glm/glm.hpp>
 #include "triangleObject.h"
 #include "logging.h"
-#include "SOIL.h"
 
 /// Set up vertex data (and buffer(s)) and attribute pointers
 static GLfloat vertices[] = {
@@ -30,11 +29,13 @@ TriangleObject::TriangleObject(Shader* pShader, const char* texturePath)
 
     _pShader = pShader;
     _texturePath = texturePath;
+    _vbo = _ebo = _vao = _tex = 0;
 
     _objectColor = glm::vec3(0);
     _isFocused = false;
     _focusColor = glm::vec3(0);
     _objType = Object_Triangle;
+    _time = 0.;
 }
 
 TriangleObject::TriangleObject(Shader* pShader, glm::vec3 objectColor) : TriangleObject(pShader, nullptr)
@@ -64,44 +65,39 @@ bool TriangleObject::Initialize()
         return false;
     }
 
+    GetUniformLocations();
+
     return true;
 }
 
-bool TriangleObject::CreateTexture()
+void TriangleObject::GetUniformLocations()
 {
-    if(_texturePath == nullptr)
-        return true;
-
-    glGenTextures(1, &_tex);
+    _texImgLoc = _pShader->GetUniform("TexImg");
+    _PVMLoc = _pShader->GetUniform("PVM");
+}
 
-    /// All upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    glBindTexture(GL_TEXTURE_2D, _tex);
+bool TriangleObject::LoadTexture()
+{
+    if(_texturePath == nullptr || !_image.Levels.empty())
+        return true;
 
-    /// Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	/// Set texture wrapping to GL_REPEAT
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    return LoadTextureImage(_texturePath, true, _image);
+}
 
-    /// Set texture filtering
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+bool TriangleObject::CreateTexture()
+{
+    if(_texturePath == nullptr)
+        return true;
 
-    /// Load, create texture and generate mipmaps
-    int width, height;
-    unsigned char* image = SOIL_load_image(_texturePath, &width, &height, 0, SOIL_LOAD_RGBA);
-    if(image == NULL)
-    {
-        LogError("SOIL_load_image fail \n");
+    /// Load the image unless it was loaded in advance
+    if(!LoadTexture())
         return false;
-    }
 
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    SOIL_free_image_data(image);
+    _tex = CreateTextureObject(_image, GL_REPEAT);
+    vector<TextureLevel>().swap(_image.Levels);
+    vector<unsigned char>().swap(_image.Data);
 
-    /// Unbind texture when done, so we won't accidentally mess up our texture.
-    glBindTexture(GL_TEXTURE_2D, 0);
-
-    return true;
+    return _tex != 0;
 }
 
 bool TriangleObject::CreateVAO()
@@ -177,14 +173,13 @@ bool TriangleObject::SetTextureToShader()
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, _tex);
 
-    GLint imgLoc = glGetUniformLocation (_pShader->GetProgram(), "TexImg");
-	if(imgLoc <= -1)
+	if(!_texImgLoc.IsValid())
     {
         LogError("Failed to get Uniform TexImg \n");
         return false;
 	}
 
-    glUniform1i(imgLoc, 0);
+    _texImgLoc.Set(0);
 
     return true;
 }
@@ -205,14 +200,13 @@ bool TriangleObject::DrawNextFrame(const double time, glm::mat4 PV, StudioEnv& s
     glm::mat4 modelMat = _T* R *_S;
     glm::mat4 PVM = PV * modelMat;
 
-    GLint PVMLoc = glGetUniformLocation (_pShader->GetProgram(), "PVM");
-	if(PVMLoc <= -1)
+	if(!_PVMLoc.IsValid())
     {
         LogError("Failed to get Uniform PVM \n");
         return false;
 	}
 
-    glUniformMatrix4fv(PVMLoc, 1, GL_FALSE,  &PVM[0][0]);
+    _PVMLoc.Set(PVM);
 
     DrawContainer();
 